@@ -12,8 +12,12 @@
 #include "em_gpio.h"
 #include "em_cmu.h"
 #include "em_assert.h"
+#include "em_ldma.h"
 #include "scheduler.h"
 #include "sleep_routine.h"
+#include "rtcc.h"
+#include "i2c_trace.h"
+#include "profiler.h"
 #include "Si7021.h"
 
 
@@ -28,6 +32,25 @@
 #define writeCommand      0xE6
 #define twoBytesLeft            2
 #define SH_address    0x70
+#define I2C_QUEUE_SIZE    8     // pending transactions held per bus while it is busy
+#define I2C_NUM_INSTANCES 2
+#define I2C_MAX_NACK_RETRIES  8     // NACKs tolerated per transaction before it is stopped
+#define I2C_TIMEOUT_MS        20    // deadline of one transaction from START to MSTOP, retries included
+#define I2C_RECOVERY_CLOCKS   9     // SCL pulses that free a slave holding SDA low
+#define I2C_RECOVERY_HALF_MS  1     // SCL half period of the recovery clocks, slaves have no minimum clock rate
+#define I2C_RESET_SPIN_MAX    10000 // MSTOP polls of the bus reset in i2c_open(), well over one START and STOP
+#define I2C_MAX_DEVICES       4     // devices per bus with their own speed profile
+#define I2C_INSTANCE(i2c) (((uint32_t)(i2c) - I2C0_BASE) / (I2C1_BASE - I2C0_BASE)) // I2C0 -> 0, I2C1 -> 1
+
+// LDMA transfer mode, see i2c_ldma_begin() in I2C.c
+// emlib's em_ldma.c must be built with LDMA_IRQ_HANDLER_NONE defined, the LDMA_IRQHandler lives in I2C.c
+#define I2C_LDMA_MAX_CMD_BYTES  4     // command bytes moved to TXDATA by the TX channel
+#define I2C_LDMA_MAX_RX_BYTES   8     // largest read the RX channel can stage
+#define I2C_LDMA_MIN_RX_BYTES   3     // shorter reads are cheaper on the RXDATAV interrupt
+#define I2C0_LDMA_TX_CH         0
+#define I2C0_LDMA_RX_CH         1
+#define I2C1_LDMA_TX_CH         2
+#define I2C1_LDMA_RX_CH         3
 
 
 
@@ -47,23 +70,65 @@ typedef struct{
   uint32_t ROUTEsda;
   bool scl_pin_en;
   bool sda_pin_en;
+  bool ldma_en; // move command and payload bytes with the LDMA instead of one interrupt per byte
+  uint32_t error_cb; // scheduled instead of the callback of a transaction that fails
+  GPIO_Port_TypeDef scl_port; // pins driven by the GPIO during bus recovery
+  uint32_t scl_pin;
+  GPIO_Port_TypeDef sda_port;
+  uint32_t sda_pin;
 
 
 
 }I2C_OPEN_STRUCT_TypeDef;
 
 
+// bus speed applied when a transaction starts, see i2c_set_device_speed()
+typedef enum{
+  I2C_SPEED_OPEN,         // freq and clhr given to i2c_open()
+  I2C_SPEED_STANDARD,     // 100 kHz, standard 4:4 clock
+  I2C_SPEED_FAST,         // 400 kHz, asymmetric 6:3 clock
+  I2C_SPEED_FAST_PLUS,    // 1 MHz, fast 11:6 clock, the device and the pull ups must support it
+  I2C_NUM_SPEEDS
+}I2C_SPEED;
+
+
 typedef enum{
   Init,
   SetReg,
   Hold,
   Write,
   RXState,
-  Close
+  Close,
+  Recovery,
+  I2C_NUM_STATES
 
 }DEFINED_STATES;
 
 
+typedef enum{
+  I2C_STEP_WRITE,   // START, address, command bytes, STOP
+  I2C_STEP_READ,    // START, address, command bytes, repeated START, read bytes, STOP (no command: START, read)
+  I2C_STEP_DELAY    // bus kept but idle, the CPU may enter EM2 until the RTCC delay expires
+}I2C_STEP_TYPE;
+
+
+typedef struct{
+  I2C_STEP_TYPE type;
+  uint32_t command;
+  uint32_t numCmdBytes;
+  uint32_t *bufferAddress;  // read steps only
+  uint32_t bytes;           // read steps only
+  uint32_t delayMs;         // delay steps only
+  uint8_t *byteBuffer;      // read steps only, when set bytes are stored in bus order here instead of bufferAddress
+  bool stopBeforeRead;      // read steps only, STOP after the command instead of a repeated start
+}I2C_CHAIN_STEP;
+
+
+// called from the interrupt that ends a chain, before its callback event is scheduled, with false when the chain was
+// abandoned on a failure, the buffers of the read steps are not touched again until it returns
+typedef void (*I2C_CHAIN_HOOK)(bool ok);
+
+
 typedef struct{
   uint32_t newDeviceAddress;
   uint32_t newRegisterAddress;
@@ -76,6 +141,11 @@ typedef struct{
   uint32_t newRepeatedStart;
   uint32_t newCombinedBytes;
   uint32_t newNumCmdBytes;
+  const I2C_CHAIN_STEP *newChain;  // when set the steps are run instead of the fields above
+  uint32_t newChainSteps;
+  I2C_CHAIN_HOOK newChainHook;  // chains only, 0 for none
+  uint8_t *newByteBuffer;  // when set read bytes are stored in bus order instead of shifted into newBufferAddress
+  bool newStopBeforeRead;  // reads only, for devices that take no repeated start, STOP after the command
 
 
 }STATE_MACHINE_START_STRUCT;
@@ -83,7 +153,13 @@ typedef struct{
 
 
 
-void i2c_start(I2C_TypeDef *i2c, STATE_MACHINE_START_STRUCT *openStruct);
+bool i2c_start(I2C_TypeDef *i2c, STATE_MACHINE_START_STRUCT *openStruct);
+bool i2c_start_chain(I2C_TypeDef *i2c, uint32_t deviceAddress, const I2C_CHAIN_STEP *steps, uint32_t numSteps, uint32_t callback,
+                     I2C_CHAIN_HOOK hook);
 void i2c_open(I2C_TypeDef *i2c_v, I2C_OPEN_STRUCT_TypeDef *I2C_T);
+uint32_t i2c_get_isr_count(I2C_TypeDef *i2c);
+void i2c_set_device_speed(I2C_TypeDef *i2c, uint32_t deviceAddress, I2C_SPEED speed);
+void i2c_bus_reset(I2C_TypeDef *i2c);
+void LDMA_IRQHandler(void);
 
 #endif /* SRC_HEADER_FILES_I2C_H_ */
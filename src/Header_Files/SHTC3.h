@@ -18,10 +18,43 @@
 #include "em_i2c.h"
 #include "brd_config.h"
 #include "HW_delay.h"
+#include "conversion.h"
+#include "crc8.h"
+#include "sample_queue.h"
 
 
 // command defines
 #define SHTC3_Delay         240
+#define SHTC3_WAKEUP_MS     1       // 240 us wakeup time, rounded up to the RTCC tick
+#define SHTC3_MEASURE_MS    13      // 12.1 ms maximum normal mode measurement, rounded up
+#define SHTC3_MEASURE_LP_MS 1       // 0.8 ms maximum low power mode measurement, rounded up
+#define SHTC3_LDMA_EN       true    // move the two byte commands and six byte reply with the LDMA
+#define SHTC3_SPEED         I2C_SPEED_FAST        // I2C_SPEED_FAST_PLUS once the pull ups are verified for 1 MHz
+#define SHTC3_FRAME_BYTES   6       // two words, each followed by its CRC
+#define SHTC3_TEMP_WORD     0       // frame offset of the temperature word with the temperature first commands
+#define SHTC3_RH_WORD       3       // frame offset of the humidity word
+#define SHTC3_CRC_RETRIES   1       // measurements repeated after a CRC failure before the sample is dropped, see app.c
+
+// precision policy, a sample stable to these steps and away from the alert threshold selects low power mode
+// awake time per sample is wakeup + measurement + bus time: about 14 ms normal and 2 ms low power at 1 ms RTCC ticks
+#define SHTC3_STABLE_TEMP_CENTI 20      // 0.2 C between samples
+#define SHTC3_STABLE_RH_CENTI   100     // 1 %RH between samples
+#define SHTC3_NO_ALERT          INT32_MIN
+
+// sleep elision cost model, currents in nA and times in us, tools/shtc3_sleep_sweep.py prints it over 100 ms to 60 s
+// sleeping costs the wakeup and sleep transactions and the wakeup time every sample, staying awake costs the idle
+// minus sleep current of the sensor for the whole period
+#define SHTC3_IDLE_NA           45000     // sensor idle current between measurements
+#define SHTC3_SLEEP_NA          300       // sensor sleep current
+#define SHTC3_MCU_ACTIVE_NA     1200000   // MCU in EM1 while a transaction is on the bus
+#define SHTC3_SLEEP_PAIR_US     200       // MCU time of the wakeup and sleep transactions with their interrupts
+#define SHTC3_PULLUP_NA         700000    // SCL and SDA pull ups, 3.3 V over 4.7 kOhm, each low about half the bus time
+#define SHTC3_SLEEP_PAIR_BUS_US 145       // wakeup and sleep transactions on the bus, 29 clocks each at 400 kHz
+// the break even period is about 9 ms, so the LETIMER periods always sleep the sensor, true runs the awake chain
+// for bring up regardless of the period
+#define SHTC3_FORCE_KEEP_AWAKE  false
+#define SHTC3_AWAKE_FIRST_STEP  2         // measure chain step the awake chain starts at, after wakeup and its delay
+#define SHTC3_AWAKE_CHAIN_STEPS 3         // measure, delay, read, without the sleep command
 #define SHTC3_sleep_cmd     0xB098
 #define SHTC3_wakeup_cmd    0x3517
 #define twoByte 2
@@ -41,14 +74,25 @@
 #define humFirstReadCmd       0x58E0
 
 #define SH_address    0x70
-//functions
 
-void SH_I2C_OPEN();
-void shtc3_read_data_and_crc(uint32_t callback_event);
-float get_SH_rh(void);
-float get_SH_temp(void);
+typedef enum{
+  SHTC3_NORMAL,     // 12.1 ms measurement, full repeatability
+  SHTC3_LOW_POWER,  // 0.8 ms measurement, lower repeatability
+  SHTC3_NUM_PRECISIONS
+}SHTC3_PRECISION;
+
+//functions
 
-void return_temp_hum(float *t, float *h);
+void SH_I2C_open(uint32_t error_cb);
+bool shtc3_read_data_and_crc(uint32_t callback_event);
+uint32_t shtc3_get_crc_errors(void);
+void shtc3_set_rh_alert(int32_t rh_centi);
+SHTC3_PRECISION shtc3_get_precision(void);
+void shtc3_set_sample_period(uint32_t period_ms);
+bool shtc3_get_keep_awake(void);
+void shtc3_bus_error(void);
+void shtc3_app_get_temp_and_hum(const SAMPLE_RECORD *record, int32_t *T, int32_t *H);
+void shtc3_sample_done(int32_t temp, int32_t rh);
 
 #define tempHelper 0xFFFF;
 
@@ -19,23 +19,56 @@
 #include "em_i2c.h"
 #include "brd_config.h"
 #include "HW_delay.h"
+#include "conversion.h"
+#include "sample_queue.h"
 
 #define I2C_freq I2C_FREQ_FAST_MAX;
 #define I2C_clk_ratio i2cClockHLRAsymetric;
-#define SI7021_POWERON_DELAY   80
 #define SI7021_Address    0x40
 #define SI7021_CMD_MEASURE_RH_NO_HOLD    0xF5         /**< Measure Relative Humidity, No Hold Master Mode */
 #define SI7021_CMD_MEASURE_TEMP           0xE0
+#define SI7021_CMD_MEASURE_TEMP_NO_HOLD   0xF3
+#define SI7021_MEASURE_CHAIN_STEPS        3
+#define SI7021_PAIR_CHAIN_STEPS           4     // the RH measurement chain followed by the temperature read
+#define SI7021_PIPE_CHAIN_STEPS           3     // read the finished pair, start the next RH conversion
+#define SI7021_RES_CHAIN_STEPS            2     // write user register 1, read it back
+#define SI7021_NUM_RESOLUTIONS            4
+#define SI7021_RES_RH12_T14               0     // user register RES1:RES0 codes
+#define SI7021_RES_RH8_T12                1
+#define SI7021_RES_RH10_T13               2
+#define SI7021_RES_RH11_T11               3
+#define SI7021_RESOLUTION                 SI7021_RES_RH12_T14     // power on default
+#define SI7021_CMD_WRITE_USER_REG         0xE6
+#define SI7021_CMD_READ_USER_REG          0xE7
+#define SI7021_USER_REG_DEFAULT           0x3A    // reset value, heater off, VDD ok
+#define SI7021_USER_REG_RES1              0x80
+#define SI7021_USER_REG_RES0              0x01
+#define SI7021_USER_REG_RES_MASK          (SI7021_USER_REG_RES1 | SI7021_USER_REG_RES0)
 #define writeData         0x01
+#define SI7021_LDMA_EN    false       // two byte reads are cheaper on the per byte interrupts
+#define SI7021_SPEED      I2C_SPEED_FAST    // 400 kHz is the fastest the Si7021 supports
 
+typedef enum{
+  SI7021_PIPE_PRIMING,    // only the first conversion was started, no pair this period
+  SI7021_PIPE_READING,    // the pair is being read
+  SI7021_PIPE_REFUSED     // the bus queue was full, nothing was submitted
+}SI7021_PIPE_STATUS;
 
 
-void si7021_i2c_open();
+void si7021_i2c_open(uint32_t error_cb);
 void SI7021_Read_Helper(uint8_t command, uint8_t bytes, uint32_t callback);
 void SI7021_Write_Helper(uint8_t bytes, uint8_t command);
+void si7021_set_resolution(uint32_t resolution, uint32_t callback);
+void si7021_read_resolution(uint32_t callback);
+uint32_t si7021_get_resolution(void);
 
-uint32_t get_Si7021_temp(void);
-float get_si7021_rh(void);
+int32_t get_Si7021_temp(void);
+int32_t get_si7021_rh(void);
+bool si7021_read_rh_and_temp(uint32_t callback);
+void si7021_get_rh_and_temp(const SAMPLE_RECORD *record, int32_t *rh, int32_t *temp);
+SI7021_PIPE_STATUS si7021_pipeline_sample(uint32_t callback);
+void si7021_pipeline_reset(void);
+void si7021_power_on(void);
 
 
 #endif /* SRC_HEADER_FILES_SI7021_H_ */
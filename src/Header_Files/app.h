@@ -20,21 +20,34 @@
 #include "sleep_routine.h"
 #include "I2C.h"
 #include "Si7021.h"
+#include "SHTC3.h"
+#include "rtcc.h"
+#include "sensor_power.h"
+#include "sensor_policy.h"
+#include "sample_queue.h"
+#include "task.h"
 
 
-// Application scheduled events
-#define LETIMER0_COMP0_CB 0b000000001 //0b0001
-#define LETIMER0_COMP1_CB 0b000000010 //0b0010
-#define LETIMER0_UF_CB 0b000000100 //0b0100
+// Application scheduled event ids, the _CB masks are what the drivers are handed as callbacks
+#define LETIMER0_COMP0_EVT  0
+#define LETIMER0_COMP1_EVT  1
+#define LETIMER0_UF_EVT     2
+#define GPIO_ODD_IRQ_EVT    3
+#define GPIO_EVEN_IRQ_EVT   4
+#define SI7021_TASK_EVT     5     // Si7021 sampling thread, also its bus error and supply ready callback
+#define SH_TASK_EVT         8     // SHTC3 sampling thread, also its bus error callback
 
-#define GPIO_ODD_IRQ_CB 0b000001000
-#define GPIO_EVEN_IRQ_CB 0b000010000
+#define LETIMER0_COMP0_CB   SCHEDULER_EVENT_MASK(LETIMER0_COMP0_EVT)
+#define LETIMER0_COMP1_CB   SCHEDULER_EVENT_MASK(LETIMER0_COMP1_EVT)
+#define LETIMER0_UF_CB      SCHEDULER_EVENT_MASK(LETIMER0_UF_EVT)
 
-#define SI7021_READ_CB 0b000100000
-#define SI7021_READ_TEMP_CB 0b010000000
-#define SH_CB               0b100000000
+#define GPIO_ODD_IRQ_CB     SCHEDULER_EVENT_MASK(GPIO_ODD_IRQ_EVT)
+#define GPIO_EVEN_IRQ_CB    SCHEDULER_EVENT_MASK(GPIO_EVEN_IRQ_EVT)
 
-#define SI7021_HUMIDITY_LED_THRESHOLD 30
+
+#define SI7021_HUMIDITY_LED_THRESHOLD 3000    // centi-percent RH
+#define SI7021_PIPELINED    true    // read last period's conversion and start the next one instead of waiting for it
+#define SENSOR_PRIMARY      SENSOR_SHTC3    // read every period, the other sensor only cross checks it
 
 
 
@@ -62,8 +75,8 @@ void scheduled_letimer0_COMP0_cb(void);
 void scheduled_letimer0_COMP1_cb(void);
 void scheduled_gpio_odd_irq_cb(void);
 void scheduled_gpio_even_irq_cb(void);
-void scheduled_si7021_read_cb(void);
-void scheduled_si7021_read_temp_cb(void);
+void scheduled_si7021_task_cb(void);
+void scheduled_SHTC3_task_cb(void);
 
 
 #endif
@@ -0,0 +1,53 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	CONVERSION_HG
+#define	CONVERSION_HG
+
+/* System include statements */
+#include <stdint.h>
+
+/* Silicon Labs include statements */
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+// Every sensor reading is kept as centi-degrees Celsius (0.01 C) and centi-percent RH (0.01 %RH).
+// A datasheet formula value = A * raw / 65536 + B becomes ((100A * raw + 32768) >> 16) + 100B, which is the exact
+// formula rounded to the nearest 0.01, so the kernels are within 0.005 C / 0.005 %RH of the float reference.
+#define CONV_ROUND              32768     // half of the 2^16 datasheet divisor
+
+#define CONV_SI7021_RH_K        12500     // RH = 125 * raw / 65536 - 6
+#define CONV_SI7021_RH_OFF      (-600)
+#define CONV_SI7021_TEMP_K      17572     // T = 175.72 * raw / 65536 - 46.85
+#define CONV_SI7021_TEMP_OFF    (-4685)
+#define CONV_SHTC3_RH_K         10000     // RH = 100 * raw / 65536
+#define CONV_SHTC3_RH_OFF       0
+#define CONV_SHTC3_TEMP_K       17500     // T = 175 * raw / 65536 - 45
+#define CONV_SHTC3_TEMP_OFF     (-4500)
+
+#define CONV_ALERT_BAND_CENTI   300       // a humidity within 3 %RH either side of the alert threshold is near it
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef struct{
+  int32_t tempCenti;    // 0.01 C
+  int32_t rhCenti;      // 0.01 %RH
+}SENSOR_SAMPLE;
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+int32_t conv_si7021_rh(uint32_t raw);
+int32_t conv_si7021_temp(uint32_t raw);
+int32_t conv_shtc3_rh(uint32_t raw);
+int32_t conv_shtc3_temp(uint32_t raw);
+uint32_t conv_abs_diff(int32_t a, int32_t b);
+
+#endif
@@ -0,0 +1,52 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	CRC8_HG
+#define	CRC8_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_cmu.h"
+#include "em_gpcrc.h"
+#include "em_core.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+// Sensirion CRC-8: polynomial x^8 + x^5 + x^4 + 1 (0x31), initial value 0xFF, MSB first, no final XOR
+#define CRC8_POLY           0x31
+#define CRC8_INIT           0xFF
+
+// backends, pick one with CRC8_BACKEND
+#define CRC8_BACKEND_TABLE  0     // 256 byte table, one lookup per byte
+#define CRC8_BACKEND_NIBBLE 1     // 16 byte table, two lookups per byte, for small flash
+#define CRC8_BACKEND_GPCRC  2     // GPCRC peripheral as a 16 bit CRC with the polynomial and init shifted up a byte
+#define CRC8_BACKEND        CRC8_BACKEND_TABLE
+
+#define CRC8_GPCRC_POLY     (CRC8_POLY << 8)
+#define CRC8_GPCRC_INIT     0x00FF    // CRC8_INIT << 8, bit reversed as the GPCRC shifts LSB first
+
+// known answer checked at crc8_open() by the GPCRC backend, the example of the Sensirion datasheets
+#define CRC8_CHECK_MSB      0xBE
+#define CRC8_CHECK_LSB      0xEF
+#define CRC8_CHECK_CRC      0x92
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void crc8_open(void);
+uint8_t crc8_compute(const uint8_t *data, uint32_t len);
+
+#endif
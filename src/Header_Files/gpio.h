@@ -16,6 +16,7 @@
 
 /* The developer's include statements */
 #include "brd_config.h"
+#include "profiler.h"
 
 //***********************************************************************************
 // defined files
@@ -0,0 +1,70 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	I2C_TRACE_HG
+#define	I2C_TRACE_HG
+
+/* System include statements */
+#include <stdint.h>
+
+/* Silicon Labs include statements */
+#include "em_timer.h"
+#include "em_cmu.h"
+#include "em_core.h"
+#include "em_assert.h"
+
+/* The developer's include statements */
+#include "rtcc.h"
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define I2C_TRACE_ENABLE            // comment out to compile the trace and its calls out of the driver
+
+#define I2C_TRACE_SIZE      64      // entries kept, the oldest is overwritten when full
+#define I2C_TRACE_TIMER     WTIMER0 // 32 bit free running timestamp, counts in EM0 and EM1
+#define I2C_TRACE_TIMER_CLK cmuClock_WTIMER0
+#define I2C_TRACE_PRESC     timerPrescale16
+
+#ifdef I2C_TRACE_ENABLE
+#define I2C_TRACE(bus, type, state, arg)  i2c_trace_record((bus), (type), (state), (arg))
+#else
+#define I2C_TRACE(bus, type, state, arg)  ((void)(arg))
+#endif
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+// tools/i2c_trace_decode.py turns a dump of these entries into a timeline, keep it in step with the layout below
+typedef enum{
+  I2C_TRACE_START,      // transaction loaded, arg is the device address
+  I2C_TRACE_IRQ,        // I2C or LDMA interrupt entry, arg is the flags being handled
+  I2C_TRACE_STATE,      // state machine moved to state, arg is the previous state
+  I2C_TRACE_NACK,       // NACK retried, arg is the retries of the transaction so far
+  I2C_TRACE_COMPLETE,   // MSTOP of the transaction, arg is its interrupt entries
+  I2C_TRACE_TIMEOUT,    // deadline expired, recovery started
+  I2C_TRACE_FAIL        // transaction ended with the error callback
+}I2C_TRACE_TYPE;
+
+typedef struct{
+  uint32_t time;        // I2C_TRACE_TIMER count, HFPERCLK / 16 ticks, frozen while in EM2 and below
+  uint16_t rtcc;        // low half of the RTCC count, orders entries across EM2 delays
+  uint8_t  bus;         // I2C instance
+  uint8_t  type;        // I2C_TRACE_TYPE
+  uint8_t  state;       // DEFINED_STATES when recorded
+  uint8_t  spare[3];
+  uint32_t arg;
+}I2C_TRACE_ENTRY;
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void i2c_trace_open(void);
+void i2c_trace_record(uint32_t bus, I2C_TRACE_TYPE type, uint32_t state, uint32_t arg);
+uint32_t i2c_trace_copy(I2C_TRACE_ENTRY *out, uint32_t maxEntries, uint32_t *dropped);
+void i2c_trace_clear(void);
+
+#endif
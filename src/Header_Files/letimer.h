@@ -14,6 +14,7 @@
 #include "em_assert.h"
 #include "scheduler.h"
 #include "sleep_routine.h"
+#include "profiler.h"
 
 /* The developer's include statements */
 
@@ -21,6 +21,7 @@
 #include "app.h"
 #include "brd_config.h"
 #include "scheduler.h"
+#include "profiler.h"
 
 //***********************************************************************************
 // defined files
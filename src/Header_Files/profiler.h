@@ -0,0 +1,76 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	PROFILER_HG
+#define	PROFILER_HG
+
+/* System include statements */
+#include <stdint.h>
+
+/* Silicon Labs include statements */
+#include "em_device.h"
+#include "em_core.h"
+#include "em_assert.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+//#define PROFILE_ENABLE            // uncomment to bracket the ISRs and the main loop dispatches with cycle counts
+
+// cycle counter read by the brackets, define it before this header to run the profiler on another clock
+#ifndef PROFILER_CYCLES
+#define PROFILER_CYCLES()   (DWT->CYCCNT)
+#endif
+
+#ifdef PROFILE_ENABLE
+#define PROFILE_START(id)   uint32_t profile_start_##id = PROFILER_CYCLES()
+#define PROFILE_STOP(id)    profiler_record((id), PROFILER_CYCLES() - profile_start_##id)
+#else
+#define PROFILE_START(id)
+#define PROFILE_STOP(id)
+#endif
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+// one entry per bracketed ISR or scheduled callback
+typedef enum{
+  PROFILE_I2C0_IRQ,
+  PROFILE_I2C1_IRQ,
+  PROFILE_LDMA_IRQ,
+  PROFILE_RTCC_IRQ,
+  PROFILE_LETIMER0_IRQ,
+  PROFILE_GPIO_ODD_IRQ,
+  PROFILE_GPIO_EVEN_IRQ,
+  PROFILE_LETIMER0_UF_CB,
+  PROFILE_LETIMER0_COMP0_CB,
+  PROFILE_LETIMER0_COMP1_CB,
+  PROFILE_GPIO_ODD_IRQ_CB,
+  PROFILE_GPIO_EVEN_IRQ_CB,
+  PROFILE_SI7021_TASK,    // one resume of the thread, the cost of a task switch
+  PROFILE_SH_TASK,
+  PROFILE_I2C_TRACE,      // one i2c_trace_record(), the time it masks interrupts
+  PROFILE_NUM_IDS
+}PROFILE_ID;
+
+typedef struct{
+  uint32_t calls;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint32_t meanCycles;
+}PROFILE_REPORT;
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void profiler_open(void);
+void profiler_record(PROFILE_ID id, uint32_t cycles);
+void profiler_report(PROFILE_REPORT *report);
+void profiler_clear(void);
+
+#endif
@@ -0,0 +1,60 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	RTCC_HG
+#define	RTCC_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_rtcc.h"
+#include "em_cmu.h"
+#include "em_assert.h"
+#include "sleep_routine.h"
+#include "profiler.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define RTCC_HZ         1000      // Clocked from the ULFRCO through the LFE clock tree
+
+#define RTCC_EM         EM4       // The ULFRCO keeps the RTCC running down to EM3, block EM4 while a delay is armed
+
+#define RTCC_TIMER_CH   0         // compare channel all the software timers share
+#define RTCC_MAX_TIMERS 8         // timers armed at the same time, both I2C buses, sensor power and spares
+#define RTCC_TIMER_IDLE 0         // RTCC_TIMER.index of a timer that is not armed
+#define RTCC_MIN_AHEAD  2         // ticks between the count and an overdue compare, one may pass while it is written
+#define RTCC_MAX_TICKS  0x7FFFFFFFu // longest delay, deadlines are compared as signed differences
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef void (*RTCC_CALLBACK)(void *arg);
+
+// owned by the caller, a zero filled timer is idle
+typedef struct{
+  uint32_t deadline;        // RTCC count it expires at
+  uint32_t period;          // ticks between periodic expiries, 0 for a one shot
+  RTCC_CALLBACK callback;
+  void *arg;
+  uint32_t index;           // heap position + 1, RTCC_TIMER_IDLE when not armed
+}RTCC_TIMER;
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void rtcc_open(void);
+void rtcc_timer_start(RTCC_TIMER *timer, uint32_t ms, uint32_t period_ms, RTCC_CALLBACK callback, void *arg);
+void rtcc_timer_stop(RTCC_TIMER *timer);
+bool rtcc_timer_armed(const RTCC_TIMER *timer);
+uint32_t rtcc_get_count(void);
+void RTCC_IRQHandler(void);
+
+#endif
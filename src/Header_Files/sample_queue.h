@@ -0,0 +1,57 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	SAMPLE_QUEUE_HG
+#define	SAMPLE_QUEUE_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_assert.h"
+
+/* The developer's include statements */
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SAMPLE_QUEUE_SIZE   4     // records held per sensor, a power of two
+#define SAMPLE_QUEUE_MASK   (SAMPLE_QUEUE_SIZE - 1)
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef enum{
+  SENSOR_SI7021,
+  SENSOR_SHTC3,
+  SENSOR_NUM_IDS
+}SENSOR_ID;
+
+typedef enum{
+  SAMPLE_OK,
+  SAMPLE_CRC_ERROR,   // the reply failed its CRC, the raw words are not usable
+  SAMPLE_BUS_ERROR    // the measurement chain was abandoned, the raw words are not usable
+}SAMPLE_STATUS;
+
+// one measurement as it came off the bus, converted by the main loop
+typedef struct{
+  uint32_t timestamp;   // RTCC count when the measurement chain ended
+  uint16_t rawRh;
+  uint16_t rawTemp;
+  uint8_t sensor;       // SENSOR_ID
+  uint8_t status;       // SAMPLE_STATUS
+}SAMPLE_RECORD;
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sample_queue_open(void);
+bool sample_queue_post(const SAMPLE_RECORD *record);
+bool sample_queue_get(SENSOR_ID sensor, SAMPLE_RECORD *record);
+uint32_t sample_queue_dropped(SENSOR_ID sensor);
+
+#endif
@@ -6,6 +6,7 @@
 
 /* System include statements */
 #include <stdint.h>
+#include <stdbool.h>
 
 /* Silicon Labs include statements */
 #include "em_assert.h"
@@ -16,11 +17,19 @@
 //***********************************************************************************
 // defined files
 //***********************************************************************************
+#define SCHEDULER_MAX_EVENTS    128     // event ids 0 to 127, a multiple of 32
+#define SCHEDULER_WORDS         (SCHEDULER_MAX_EVENTS / 32)
+#define SCHEDULER_NO_SLOT       0xFF    // event without a registered handler
+#define SCHEDULER_NO_PROFILE    0xFFFFFFFF
+
+// events 0 to 31 can also be posted as a mask with add_scheduled_events(), which is how the drivers take callbacks
+#define SCHEDULER_EVENT_MASK(id)  (1u << (id))
 
 
 //***********************************************************************************
 // global variables
 //***********************************************************************************
+typedef void (*SCHEDULER_HANDLER)(void);
 
 
 //***********************************************************************************
@@ -30,6 +39,10 @@ void scheduler_open(void);
 void add_scheduled_events(uint32_t event);
 void remove_scheduled_events(uint32_t event);
 uint32_t get_scheduled_events(void);
+void scheduler_register(uint32_t event_id, uint32_t priority, SCHEDULER_HANDLER handler, uint32_t profile_id);
+void scheduler_post(uint32_t event_id);
+bool scheduler_pending(void);
+void scheduler_dispatch(void);
 
 
 #endif
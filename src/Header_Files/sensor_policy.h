@@ -0,0 +1,57 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	SENSOR_POLICY_HG
+#define	SENSOR_POLICY_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_assert.h"
+
+/* The developer's include statements */
+#include "conversion.h"
+#include "sample_queue.h"
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SENSOR_POLICY_VERIFY_EVERY    10      // periods between cross checks of a quiet primary
+#define SENSOR_POLICY_RATE_RH_CENTI   200     // a primary change of 2 %RH in one period is cross checked
+#define SENSOR_POLICY_RATE_TEMP_CENTI 50      // as is one of 0.5 C, or a humidity within CONV_ALERT_BAND_CENTI of the alert
+#define SENSOR_POLICY_NO_ALERT        INT32_MIN
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+// secondary minus primary, summed as the cross checks come in
+// mean = sum / count, variance = sumSq / count - mean^2
+typedef struct{
+  uint32_t count;         // cross checks
+  uint32_t rateChecks;    // of them started by a fast primary change
+  uint32_t alertChecks;   // of them started by a primary near the alert threshold
+  int64_t rhSum;          // centi-percent RH
+  uint64_t rhSumSq;
+  uint32_t rhMaxAbs;
+  int64_t tempSum;        // centi-degrees Celsius
+  uint64_t tempSumSq;
+  uint32_t tempMaxAbs;
+}SENSOR_POLICY_STATS;
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sensor_policy_open(SENSOR_ID primary, uint32_t verify_every, int32_t rh_alert);
+SENSOR_ID sensor_policy_primary(void);
+bool sensor_policy_period(void);
+bool sensor_policy_primary_sample(const SENSOR_SAMPLE *sample);
+void sensor_policy_secondary_sample(const SENSOR_SAMPLE *sample);
+void sensor_policy_get_stats(SENSOR_POLICY_STATS *stats);
+void sensor_policy_clear_stats(void);
+
+#endif
@@ -0,0 +1,56 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	SENSOR_POWER_HG
+#define	SENSOR_POWER_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_gpio.h"
+#include "em_i2c.h"
+
+/* The developer's include statements */
+#include "brd_config.h"
+#include "rtcc.h"
+#include "scheduler.h"
+#include "I2C.h"
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#define SENSOR_POWER_ON_MS        80        // Si7021 power up time over the full temperature range
+
+// gating cost model, currents in nA and times in ms
+// gating costs the power up charge every sample, staying powered costs the standby current for the whole period
+#define SENSOR_POWER_STANDBY_NA   60        // Si7021 standby current between measurements
+#define SENSOR_POWER_STARTUP_NA   3500000   // Si7021 supply current while it powers up
+#define SENSOR_POWER_STARTUP_MS   18        // Si7021 power up time at 25 C, the part of the delay drawing the startup current
+// the break even period is about 18 minutes, so the LETIMER periods never gate, true gates regardless of the period
+// for bring up
+#define SENSOR_POWER_FORCE_GATED  false
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef enum{
+  SENSOR_POWER_OFF,
+  SENSOR_POWER_RAMP,    // supply on, waiting out SENSOR_POWER_ON_MS
+  SENSOR_POWER_ON
+}SENSOR_POWER_STATE;
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void sensor_power_open(uint32_t period_ms, uint32_t ready_cb);
+void sensor_power_request(uint32_t ready_cb);
+void sensor_power_release(void);
+bool sensor_power_gated(void);
+SENSOR_POWER_STATE sensor_power_state(void);
+
+#endif
@@ -0,0 +1,92 @@
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+#ifndef	TASK_HG
+#define	TASK_HG
+
+/* System include statements */
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Silicon Labs include statements */
+#include "em_assert.h"
+
+/* The developer's include statements */
+#include "scheduler.h"
+#include "rtcc.h"
+
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+// Stackless threads run from a scheduler event. A thread is a function that returns wherever it has to wait and is
+// called again, from the top, every time its event is dispatched. The switch on task->lc jumps back to the wait it
+// returned from, so the function reads as straight line code.
+//  - locals are lost at every wait, keep what must survive one in statics or next to the TASK
+//  - one wait per source line, the line number is the resume point
+//  - no waits inside a switch of the thread itself, its case labels would clash with the resume points
+#if defined(__GNUC__) && (__GNUC__ >= 7)
+#define TASK_FALLTHROUGH      __attribute__((fallthrough))
+#else
+#define TASK_FALLTHROUGH
+#endif
+
+#define TASK_BEGIN(task)      switch((task)->lc){ case 0:
+
+#define TASK_END(task)        } (task)->lc = 0; return TASK_ENDED
+
+// returns until cond holds, cond is checked again each time the event of the task is dispatched
+#define TASK_WAIT_UNTIL(task, cond) \
+  do{ \
+      (task)->lc = __LINE__; \
+      TASK_FALLTHROUGH; \
+    case __LINE__: \
+      if(!(cond)){ \
+          return TASK_WAITING; \
+      } \
+  }while(0)
+
+// lets the other pending events run and carries on from the next dispatch
+#define TASK_YIELD(task) \
+  do{ \
+      (task)->lc = __LINE__; \
+      task_signal(task); \
+      return TASK_WAITING; \
+    case __LINE__: \
+      ; \
+  }while(0)
+
+// sleeps ms on the RTCC, the CPU may enter EM2 meanwhile
+#define TASK_DELAY(task, ms) \
+  do{ \
+      task_delay_start((task), (ms)); \
+      TASK_WAIT_UNTIL((task), !rtcc_timer_armed(&(task)->timer)); \
+  }while(0)
+
+
+//***********************************************************************************
+// global variables
+//***********************************************************************************
+typedef enum{
+  TASK_WAITING,     // returned at a wait, resumes on the next dispatch of its event
+  TASK_ENDED        // ran off TASK_END, starts from the top on the next dispatch
+}TASK_STATUS;
+
+typedef struct{
+  uint16_t lc;          // source line the thread resumes at, 0 for the top
+  uint8_t eventId;      // scheduler event the thread runs from
+  RTCC_TIMER timer;     // TASK_DELAY deadline
+}TASK;
+
+typedef TASK_STATUS (*TASK_THREAD)(TASK *task);
+
+
+//***********************************************************************************
+// function prototypes
+//***********************************************************************************
+void task_open(TASK *task, uint32_t event_id);
+void task_signal(TASK *task);
+uint32_t task_event(const TASK *task);
+void task_delay_start(TASK *task, uint32_t ms);
+
+#endif
@@ -9,8 +9,61 @@
 #include "I2C.h"
 
 
+#define I2C_CPU_IEN   (I2C_IEN_ACK | I2C_IEN_NACK | I2C_IEN_MSTOP | I2C_IEN_RXDATAV)
+#define I2C_LDMA_IEN  (I2C_IEN_NACK | I2C_IEN_MSTOP)
 
 
+// interrupt flags the state machine reacts to, in the order they are handled when several are pending
+typedef enum{
+  I2C_EVENT_TXC,
+  I2C_EVENT_ACK,
+  I2C_EVENT_NACK,
+  I2C_EVENT_RXDATAV,
+  I2C_EVENT_MSTOP,
+  I2C_NUM_EVENTS
+}I2C_EVENT;
+
+
+// fixed per bus hardware, indexed by I2C_INSTANCE()
+typedef struct{
+  I2C_TypeDef *i2c;
+  CMU_Clock_TypeDef clock;
+  IRQn_Type irq;
+  uint32_t ldmaTxCh;
+  uint32_t ldmaRxCh;
+  LDMA_PeripheralSignal_t ldmaTxSignal;
+  LDMA_PeripheralSignal_t ldmaRxSignal;
+}I2C_INSTANCE_CONFIG;
+
+static const I2C_INSTANCE_CONFIG i2c_instance_config[I2C_NUM_INSTANCES] = {
+    { I2C0, cmuClock_I2C0, I2C0_IRQn, I2C0_LDMA_TX_CH, I2C0_LDMA_RX_CH,
+      ldmaPeripheralSignal_I2C0_TXBL, ldmaPeripheralSignal_I2C0_RXDATAV },
+    { I2C1, cmuClock_I2C1, I2C1_IRQn, I2C1_LDMA_TX_CH, I2C1_LDMA_RX_CH,
+      ldmaPeripheralSignal_I2C1_TXBL, ldmaPeripheralSignal_I2C1_RXDATAV },
+};
+
+typedef struct{
+  uint32_t freq;
+  I2C_ClockHLR_TypeDef clhr;
+}I2C_SPEED_PROFILE;
+
+// indexed by I2C_SPEED, the I2C_SPEED_OPEN entry is replaced by the i2c_open() values of each bus
+static const I2C_SPEED_PROFILE i2c_speed_profile[I2C_NUM_SPEEDS] = {
+    { 0, i2cClockHLRStandard },
+    { I2C_FREQ_STANDARD_MAX, i2cClockHLRStandard },
+    { I2C_FREQ_FAST_MAX, i2cClockHLRAsymetric },
+    { I2C_FREQ_FASTPLUS_MAX, i2cClockHLRFast },
+};
+
+typedef struct{
+  uint32_t deviceAddress;
+  I2C_SPEED speed;
+}I2C_DEVICE_SPEED;
+
+static const uint32_t i2c_event_flag[I2C_NUM_EVENTS] = {
+    I2C_IF_TXC, I2C_IF_ACK, I2C_IF_NACK, I2C_IF_RXDATAV, I2C_IF_MSTOP
+};
+
 
 typedef struct{
   DEFINED_STATES  current_state;
@@ -18,25 +71,82 @@ typedef struct{
   bool ifBusy;
   uint32_t deviceAddress; // helper function sets
   bool read; // 1 is writing and 0 is reading
+  bool stopBeforeRead; // STOP between the command and the read address instead of a repeated start
   uint32_t *bufferAddress; // store read or write buffer address
+  uint8_t *byteBuffer; // when set read bytes are stored here in bus order instead of shifted into bufferAddress
+  uint32_t byteIndex; // next byteBuffer position
   uint32_t byteLefts; // helper function sets
   uint32_t I2C_CallBackEvent; // helper function sets
   uint32_t command; // helper function
   uint32_t data;
   int       numCmdBytes;
+  int       totalCmdBytes; // command length, restored when the address is NACKed
   uint32_t combinedBytes;
+  STATE_MACHINE_START_STRUCT queue[I2C_QUEUE_SIZE]; // transactions waiting for the bus
+  uint32_t queueHead; // next transaction to start
+  uint32_t queueTail; // next free slot
+  uint32_t queueCount;
+  bool ldmaEnable; // bus opened in LDMA transfer mode
+  bool ldmaActive; // transaction on the bus uses the LDMA
+  uint32_t ldmaTxCh;
+  uint32_t ldmaRxCh;
+  LDMA_PeripheralSignal_t ldmaTxSignal;
+  LDMA_PeripheralSignal_t ldmaRxSignal;
+  LDMA_Descriptor_t txDesc;
+  LDMA_Descriptor_t rxDesc[2]; // payload, then the CTRL write that clears AUTOACK
+  uint8_t txBytes[I2C_LDMA_MAX_CMD_BYTES]; // command bytes, most significant first
+  uint8_t rxBytes[I2C_LDMA_MAX_RX_BYTES]; // payload staged by the RX channel
+  uint32_t rxDmaBytes; // payload bytes handed to the RX channel
+  uint32_t isrCount; // interrupt entries of the transaction on the bus
+  uint32_t lastIsrCount; // interrupt entries of the last completed transaction
+  const I2C_CHAIN_STEP *chain; // steps of the chain owning the bus, 0 for a single transaction
+  uint32_t chainSteps;
+  uint32_t chainIndex; // step on the bus or in its delay
+  uint32_t chainCallBack; // scheduled once the last step completes
+  I2C_CHAIN_HOOK chainHook; // called once the chain ends, 0 for none
+  RTCC_TIMER timer; // timeout, delay step and recovery clock deadlines, one at a time
+  uint32_t nackRetries; // NACKs taken by the transaction on the bus
+  bool failed; // the transaction on the bus completes with the error callback
+  uint32_t errorCallBack;
+  GPIO_Port_TypeDef sclPort;
+  uint32_t sclPin;
+  GPIO_Port_TypeDef sdaPort;
+  uint32_t sdaPin;
+  uint32_t routePen; // ROUTEPEN restored after the GPIO recovery clocks
+  uint32_t recoveryClocks;
+  I2C_SPEED_PROFILE openSpeed; // bus speed given to i2c_open()
+  I2C_SPEED speed; // speed the bus is clocked at
+  I2C_DEVICE_SPEED devices[I2C_MAX_DEVICES];
+  uint32_t numDevices;
 
 }I2C_STATE_MACHINE;
 
 
 
-I2C_STATE_MACHINE i2c0;
-I2C_STATE_MACHINE i2c1;
+static I2C_STATE_MACHINE i2c_state_machines[I2C_NUM_INSTANCES];
+
+typedef void (*I2C_ACTION)(I2C_STATE_MACHINE *i2c_sm);
 
-void ACK_Interrupt(I2C_STATE_MACHINE *i2c_sm);
-void NACK_Interrupt(I2C_STATE_MACHINE *i2c_sm);
-void MSTOP_Interrupt(I2C_STATE_MACHINE *i2c_sm);
-void RXDATAV_Interrupt(I2C_STATE_MACHINE *i2c_sm);
+static I2C_STATE_MACHINE *i2c_get_state_machine(I2C_TypeDef *i2c);
+static void i2c_irq_handler(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_begin_transaction(I2C_STATE_MACHINE *i2c_sm, STATE_MACHINE_START_STRUCT *openStruct);
+static void i2c_ldma_begin(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_ldma_read_phase(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_ldma_rx_done(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_chain_step(I2C_STATE_MACHINE *i2c_sm);
+static bool i2c_chain_next(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_chain_delay_done(void *arg);
+static void i2c_next_or_idle(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_fail(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_timeout(void *arg);
+static void i2c_recovery_clock(void *arg);
+static void i2c_recovery_finish(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_apply_speed(I2C_STATE_MACHINE *i2c_sm);
+static void i2c_store_byte(I2C_STATE_MACHINE *i2c_sm, uint8_t byte);
+
+static bool ldma_opened = false;
+
+#define I2C_SM_TRACE(i2c_sm, type, arg)   I2C_TRACE(I2C_INSTANCE((i2c_sm)->I2Cx), (type), (i2c_sm)->current_state, (arg))
 
 
 /***************************************************************************/
@@ -50,6 +160,7 @@ void RXDATAV_Interrupt(I2C_STATE_MACHINE *i2c_sm);
  *
  * @note
  *   This function is used to reset the I2C bus and to
+ *   The wait on MSTOP is bounded by I2C_RESET_SPIN_MAX so a stuck bus cannot hang i2c_open()
  *
  * @param[in] i2c pointer
  *   Pointer to the base peripheral address of the i2c peripheral being used
@@ -60,13 +171,15 @@ void RXDATAV_Interrupt(I2C_STATE_MACHINE *i2c_sm);
 static void i2cx_bus_reset(I2C_TypeDef *i2c){
  //directions are on lab 5 part 1 page 14
   uint32_t IENFlags;
+  uint32_t spin;
   i2c->CMD = I2C_CMD_ABORT; // abort all stuff, so we can do stuff to the state machine
   IENFlags = i2c->IEN; // get the flags
   i2c -> IEN = _I2C_IEN_RESETVALUE; // disable all flags
   i2c->IFC = i2c->IF;
   i2c->CMD = I2C_CMD_START | I2C_CMD_STOP; // do the reset
 //  I2C_IntClear(i2c, i2c -> IF); // clear flags again to clear reset flags
-  while(!(i2c->IF & I2C_IF_MSTOP)); //as soon as the flag goes to 0, then we can proceed
+  // bounded, a bus held low is left to the timeout and recovery of the first transaction
+  for(spin = 0; !(i2c->IF & I2C_IF_MSTOP) && spin < I2C_RESET_SPIN_MAX; spin++);
   I2C_IntClear(i2c, i2c -> IF); // clear flags again to clear reset flags
   i2c->CMD = I2C_CMD_ABORT; // abort all stuff, to make sure it can be in a normal state
   i2c -> IEN = IENFlags;
@@ -92,13 +205,10 @@ static void i2cx_bus_reset(I2C_TypeDef *i2c){
 void i2c_open(I2C_TypeDef *i2c_v, I2C_OPEN_STRUCT_TypeDef *I2C_T){
 
   I2C_Init_TypeDef I2C_values;
+  I2C_STATE_MACHINE *i2c_sm = i2c_get_state_machine(i2c_v);
+  const I2C_INSTANCE_CONFIG *config = &i2c_instance_config[I2C_INSTANCE(i2c_v)];
 
-  if(i2c_v == I2C0){
-      CMU_ClockEnable(cmuClock_I2C0, true);
-  }
-  if(i2c_v == I2C1){
-      CMU_ClockEnable(cmuClock_I2C1, true);
-  }
+  CMU_ClockEnable(config->clock, true);
 
   if((i2c_v->IF & 0x01) == 0) {
 
@@ -122,10 +232,7 @@ I2C_Init(i2c_v, &I2C_values);
 I2C_IntClear(i2c_v, _I2C_IF_MASK);
 
 
-i2c_v->IEN = I2C_IEN_ACK;
-i2c_v->IEN |= I2C_IEN_NACK;
-i2c_v->IEN |= I2C_IEN_MSTOP;
-i2c_v->IEN |= I2C_IEN_RXDATAV;
+i2c_v->IEN = I2C_CPU_IEN;
 
 i2c_v->ROUTELOC0 =  I2C_T->ROUTEscl | I2C_T->ROUTEsda;
 //i2c_v->ROUTELOC0 |= I2C_T->ROUTEsda;
@@ -134,12 +241,36 @@ i2c_v->ROUTEPEN |= I2C_ROUTEPEN_SDAPEN * I2C_T->sda_pin_en;
 
 //i2cx_bus_reset(i2c_v);
 
-if (i2c_v == I2C0) {
-    NVIC_EnableIRQ(I2C0_IRQn);
-    i2c0.ifBusy = false;
-}else if(i2c_v == I2C1) {
-    NVIC_EnableIRQ(I2C1_IRQn);
-    i2c1.ifBusy = false;
+NVIC_EnableIRQ(config->irq);
+i2c_sm->I2Cx = i2c_v;
+i2c_sm->ifBusy = false;
+i2c_sm->queueHead = 0;
+i2c_sm->queueTail = 0;
+i2c_sm->queueCount = 0;
+i2c_sm->ldmaEnable = I2C_T->ldma_en;
+i2c_sm->ldmaTxCh = config->ldmaTxCh;
+i2c_sm->ldmaRxCh = config->ldmaRxCh;
+i2c_sm->ldmaTxSignal = config->ldmaTxSignal;
+i2c_sm->ldmaRxSignal = config->ldmaRxSignal;
+i2c_sm->chain = 0;
+i2c_sm->errorCallBack = I2C_T->error_cb;
+i2c_sm->sclPort = I2C_T->scl_port;
+i2c_sm->sclPin = I2C_T->scl_pin;
+i2c_sm->sdaPort = I2C_T->sda_port;
+i2c_sm->sdaPin = I2C_T->sda_pin;
+i2c_sm->openSpeed.freq = I2C_T->freq;
+i2c_sm->openSpeed.clhr = I2C_T->clhr;
+i2c_sm->speed = I2C_SPEED_OPEN;
+i2c_sm->numDevices = 0;
+
+#ifdef I2C_TRACE_ENABLE
+i2c_trace_open();
+#endif
+
+if(I2C_T->ldma_en && !ldma_opened){
+    LDMA_Init_t ldmaInit = LDMA_INIT_DEFAULT;
+    LDMA_Init(&ldmaInit);
+    ldma_opened = true;
 }
 
 i2cx_bus_reset(i2c_v);
@@ -155,192 +286,224 @@ i2cx_bus_reset(i2c_v);
  *   I2C bus start function
  *
  * @details
- *  This function is used to start the interrupt driven state machine. It first assigns all the necessary values to run the state machine such as
- *  bytesLeft, bufferAddres
+ *  This function submits a transaction to the interrupt driven state machine of the bus. If the bus is idle the
+ *  transaction is started right away, otherwise a copy of it is placed in the bus queue and the MSTOP interrupt of the
+ *  transaction in progress starts it. The function never waits on the bus, so the caller can go back to sleep.
  *
  * @note
- *   This function is used to reset the I2C bus and to
+ *   The start struct is copied, so it can live on the caller's stack. The buffer it points to must stay valid until
+ *   the callback event of the transaction is scheduled.
  *
  * @param[in] i2c pointer
  *   Pointer to the base peripheral address of the i2c peripheral being used
  *
+ * @param[in] openStruct
+ *   The transaction to run on the bus
+ *
+ * @return
+ *   false if the bus queue was full and the transaction was dropped
  *
  ******************************************************************************/
-void i2c_start(I2C_TypeDef *i2c, STATE_MACHINE_START_STRUCT *openStruct){
+bool i2c_start(I2C_TypeDef *i2c, STATE_MACHINE_START_STRUCT *openStruct){
 
-  I2C_STATE_MACHINE *i2cx_state_machine;
+  I2C_STATE_MACHINE *i2cx_state_machine = i2c_get_state_machine(i2c);
 
 
-  if(i2c == I2C0){
-      i2cx_state_machine = &i2c0;
-  }
-  else if(i2c == I2C1){
-      i2cx_state_machine = &i2c1;
-  }
-
-  while(i2cx_state_machine->ifBusy == true){
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  if(i2cx_state_machine->ifBusy == true){
+      if(i2cx_state_machine->queueCount >= I2C_QUEUE_SIZE){
+          CORE_EXIT_CRITICAL();
+          EFM_ASSERT(false); // more transactions submitted than the queue can hold
+          return false;
+      }
+      i2cx_state_machine->queue[i2cx_state_machine->queueTail] = *openStruct;
+      i2cx_state_machine->queueTail = (i2cx_state_machine->queueTail + 1) % I2C_QUEUE_SIZE;
+      i2cx_state_machine->queueCount++;
+      CORE_EXIT_CRITICAL();
+      return true;
   }
-
-  sleep_block_mode(I2C_EM_BLOCK);
   i2cx_state_machine->ifBusy = true;
-  i2cx_state_machine->I2Cx = i2c;
-
-  i2cx_state_machine->bufferAddress = openStruct->newBufferAddress;
-  i2cx_state_machine->byteLefts = openStruct->newBytesleft;
-  i2cx_state_machine->current_state = Init;
-  i2cx_state_machine->deviceAddress = openStruct->newDeviceAddress;
-  i2cx_state_machine->read = openStruct->newRead;
-  i2cx_state_machine->I2C_CallBackEvent = openStruct->newCallBack;
-  i2cx_state_machine->command = openStruct->newCommand;
-  i2cx_state_machine->combinedBytes = openStruct->newCombinedBytes;
-  i2cx_state_machine->numCmdBytes = openStruct->newNumCmdBytes;
-  i2cx_state_machine->data = openStruct->newData;
-
-
-
-  i2cx_state_machine->current_state = Init;
-
-  i2c->CMD = I2C_CMD_START;
-  i2c->TXDATA = ((WdeviceAdd << 1) | WRITE);
+  CORE_EXIT_CRITICAL();
 
+  sleep_block_mode(I2C_EM_BLOCK);
+  i2c_begin_transaction(i2cx_state_machine, openStruct);
 
+  return true;
 
 }
 
 /***************************************************************************/
 /**
  * @brief
- *  ACK interrupt driver function
- *
+ *   Loads a transaction into the state machine and starts it on the bus
  *
  * @details
- *   This function handles the functionality of the interrupt driven state machine when an ACK interrupt is received.
+ *  Called from i2c_start() when the bus is idle, and from the MSTOP interrupt when a queued transaction is next.
+ *  The bus must already be owned by the caller (ifBusy set and I2C_EM_BLOCK blocked).
  *
  * @note
- *   This function uses switch cases to handle the different states that the EFM-32 can receive ACKS in.
+ *   The read buffer is cleared here rather than by the helper functions, because the received bytes are shifted
+ *   into it and a queued transaction must not clear the buffer of the one currently on the bus.
  *
- * @param[in] i2c pointer
- *   Pointer to the i2c peripheral being used.
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
  *
+ * @param[in] openStruct
+ *   The transaction to run on the bus
  *
  ******************************************************************************/
-void ACK_Interrupt(I2C_STATE_MACHINE *i2c_sm){
-//  if(i2c_sm->current_state == SetReg){
-//      i2c_sm->I2Cx->TXDATA = i2c_sm->command;
-//  }
-//  if(i2c_sm->current_state == Hold){
-//      i2c_sm->I2Cx->TXDATA = i2c_sm->I2Cx->;
-//  }
-  switch(i2c_sm->current_state){
-    case Init:
-
-      i2c_sm->numCmdBytes--;
-      i2c_sm->I2Cx->TXDATA = (i2c_sm->command) >> (8*(i2c_sm->numCmdBytes));
-        if(i2c_sm->numCmdBytes == 0){
-         if(i2c_sm->read == false){
-             i2c_sm->current_state = Write;
-         }
-         else{
-             i2c_sm->current_state = SetReg;
-         }
-        }
-      break;
-    case SetReg:
-      if(i2c_sm->read == 1){
-          if(i2c_sm->deviceAddress == SH_address){
-              i2c_sm->I2Cx->CMD = I2C_CMD_STOP;
-          }
-          i2c_sm->I2Cx->CMD = I2C_CMD_START;
-          i2c_sm->I2Cx->TXDATA = i2c_sm->deviceAddress << 1 | READ;
-          i2c_sm->current_state = Hold;
+static void i2c_begin_transaction(I2C_STATE_MACHINE *i2c_sm, STATE_MACHINE_START_STRUCT *openStruct){
+
+  if(openStruct->newChain){
+      i2c_sm->chain = openStruct->newChain;
+      i2c_sm->chainSteps = openStruct->newChainSteps;
+      i2c_sm->chainIndex = 0;
+      i2c_sm->chainCallBack = openStruct->newCallBack;
+      i2c_sm->chainHook = openStruct->newChainHook;
+      i2c_sm->deviceAddress = openStruct->newDeviceAddress;
+      i2c_chain_step(i2c_sm);
+      return;
+  }
+
+  i2c_sm->bufferAddress = openStruct->newBufferAddress;
+  i2c_sm->byteBuffer = openStruct->newByteBuffer;
+  i2c_sm->byteLefts = openStruct->newBytesleft;
+  i2c_sm->deviceAddress = openStruct->newDeviceAddress;
+  i2c_sm->read = openStruct->newRead;
+  i2c_sm->stopBeforeRead = openStruct->newStopBeforeRead;
+  i2c_sm->I2C_CallBackEvent = openStruct->newCallBack;
+  i2c_sm->command = openStruct->newCommand;
+  i2c_sm->combinedBytes = openStruct->newCombinedBytes;
+  i2c_sm->numCmdBytes = openStruct->newNumCmdBytes;
+  i2c_sm->totalCmdBytes = openStruct->newNumCmdBytes;
+  i2c_sm->data = openStruct->newData;
+
+  I2C_SM_TRACE(i2c_sm, I2C_TRACE_START, i2c_sm->deviceAddress);
+  i2c_apply_speed(i2c_sm);
+  i2c_sm->isrCount = 0;
+  i2c_sm->nackRetries = 0;
+  i2c_sm->failed = false;
+  rtcc_timer_start(&i2c_sm->timer, I2C_TIMEOUT_MS, 0, i2c_timeout, i2c_sm);
+
+  if(i2c_sm->read == true){
+      if(i2c_sm->byteBuffer){
+          i2c_sm->byteIndex = 0;
       }
       else{
-          EFM_ASSERT(false);
+          *(i2c_sm->bufferAddress) = 0;
       }
+  }
 
-      break;
-    case Hold:
-      i2c_sm->current_state = RXState;
-//      i2c_sm->bufferAddress = bufferAddressReset;
+  i2c_sm->ldmaActive = i2c_sm->ldmaEnable && i2c_sm->numCmdBytes <= I2C_LDMA_MAX_CMD_BYTES;
+  if(i2c_sm->ldmaActive){
+      i2c_ldma_begin(i2c_sm);
+      return;
+  }
 
-      break;
-    case Write:
-//          if(i2c_sm->byteLefts >= 1){
-//
-//              i2c_sm->I2Cx->TXDATA = (*i2c_sm->bufferAddress >> (8 * (i2c_sm->byteLefts - 1)));
-//              i2c_sm->byteLefts --;
-//
-//          }
-//          else{
-               i2c_sm->I2Cx->CMD = I2C_CMD_STOP;
-               i2c_sm->current_state = Close;
-//          }
-      break;
-    case RXState:
-      EFM_ASSERT(false);
-      break;
-    case Close:
-      EFM_ASSERT(false);
-      break;
-    default:
-      EFM_ASSERT(false);
-      break;
+  i2c_sm->I2Cx->CTRL &= ~(I2C_CTRL_AUTOACK | I2C_CTRL_AUTOSE);
+  i2c_sm->I2Cx->IEN = I2C_CPU_IEN;
 
+  if(i2c_sm->read == true && i2c_sm->numCmdBytes == 0){
+      // the measurement was started earlier, address the device for the read straight away
+      i2c_sm->I2Cx->CMD = I2C_CMD_START;
+      i2c_sm->I2Cx->TXDATA = ((i2c_sm->deviceAddress << 1) | READ);
+      i2c_sm->current_state = Hold;
+      return;
   }
 
+  i2c_sm->current_state = Init;
+  i2c_sm->I2Cx->CMD = I2C_CMD_START;
+  i2c_sm->I2Cx->TXDATA = ((i2c_sm->deviceAddress << 1) | WRITE);
 
 }
 
+/***************************************************************************/
+/**
+ * @brief
+ *   Clocks the bus at the speed of the device being addressed
+ *
+ * @details
+ *  Looks the loaded device address up in the devices registered with i2c_set_device_speed(), falling back to the
+ *  i2c_open() speed, and reprograms the clock divider only when it differs from the one the bus is at. Called with
+ *  the bus idle, before the START of a transaction.
+ *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
+ *
+ ******************************************************************************/
+static void i2c_apply_speed(I2C_STATE_MACHINE *i2c_sm){
+  I2C_SPEED speed = I2C_SPEED_OPEN;
+  const I2C_SPEED_PROFILE *profile;
+  uint32_t i;
+
+  for(i = 0; i < i2c_sm->numDevices; i++){
+      if(i2c_sm->devices[i].deviceAddress == i2c_sm->deviceAddress){
+          speed = i2c_sm->devices[i].speed;
+          break;
+      }
+  }
+  if(speed == i2c_sm->speed){
+      return;
+  }
 
+  profile = (speed == I2C_SPEED_OPEN) ? &i2c_sm->openSpeed : &i2c_speed_profile[speed];
+  I2C_BusFreqSet(i2c_sm->I2Cx, 0, profile->freq, profile->clhr);
+  i2c_sm->speed = speed;
+}
 
 /***************************************************************************/
 /**
  * @brief
- * NACK interrupt driver function
- *
+ *   Starts the loaded transaction in LDMA transfer mode
  *
  * @details
- *  This function handles the functionality of the state machine when a NACK Interrupt is received by the EFM-32 from the Sensor.
- * @note
- *   This function uses switch cases to handle the different tasks of the state machine depending on the state of the state machine
+ *  The address is written by the CPU and the TX channel feeds the command bytes to TXDATA on TXBL, so no ACK
+ *  interrupt is taken per byte. A write ends with an automatic STOP (AUTOSE) and only MSTOP reaches the CPU.
+ *  A read enables TXC, and i2c_ldma_read_phase() turns the bus around once the last command byte is out.
  *
- * @param[in] i2c pointer
- *   Pointer to the i2c peripheral being used.
+ * @note
+ *   A NACK restarts the transaction from the address, the same recovery the interrupt per byte mode uses.
  *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
  *
  ******************************************************************************/
+static void i2c_ldma_begin(I2C_STATE_MACHINE *i2c_sm){
 
-void NACK_Interrupt(I2C_STATE_MACHINE *i2c_sm){
-  switch(i2c_sm->current_state){
-    case Init:
-      i2c_sm->I2Cx->CMD = I2C_CMD_START;
-      i2c_sm->I2Cx->TXDATA = (i2c_sm->deviceAddress << 1 | WRITE);
-      i2c_sm->numCmdBytes = (i2c_sm->combinedBytes - i2c_sm->byteLefts);
-      break;
-    case SetReg:
-      i2c_sm->I2Cx->TXDATA = i2c_sm->command;
-      break;
-    case Hold:
-      if(i2c_sm->read == 1){
-          if(i2c_sm->deviceAddress == SH_address){
-              i2c_sm->I2Cx->CMD  = I2C_CMD_STOP;
-          }
-          i2c_sm->I2Cx->CMD = I2C_CMD_START;
-          i2c_sm->I2Cx->TXDATA = i2c_sm->deviceAddress << 1 | READ;
-      }
-      else{
-          break;
+  LDMA_TransferCfg_t txCfg = LDMA_TRANSFER_CFG_PERIPHERAL(i2c_sm->ldmaTxSignal);
+  int i;
+
+  for(i = 0; i < i2c_sm->totalCmdBytes; i++){
+      i2c_sm->txBytes[i] = i2c_sm->command >> (8 * (i2c_sm->totalCmdBytes - 1 - i));
+  }
+  i2c_sm->numCmdBytes = 0;
+  i2c_sm->rxDmaBytes = 0;
+
+  i2c_sm->I2Cx->IFC = I2C_IF_TXC;
+  if(i2c_sm->read == true){
+      i2c_sm->I2Cx->CTRL &= ~(I2C_CTRL_AUTOACK | I2C_CTRL_AUTOSE);
+      i2c_sm->I2Cx->IEN = I2C_LDMA_IEN | I2C_IEN_TXC;
+      i2c_sm->current_state = Init;
+      if(i2c_sm->totalCmdBytes == 0){
+          i2c_ldma_read_phase(i2c_sm);
+          return;
       }
-      break;
-    case RXState:
-      EFM_ASSERT(false);
-      break;
-    case Close:
-      EFM_ASSERT(false);
-      break;
-    default:
-      EFM_ASSERT(false);
-      break;
+  }
+  else{
+      i2c_sm->I2Cx->CTRL = (i2c_sm->I2Cx->CTRL & ~I2C_CTRL_AUTOACK) | I2C_CTRL_AUTOSE;
+      i2c_sm->I2Cx->IEN = I2C_LDMA_IEN;
+      i2c_sm->current_state = Close;
+  }
+
+  i2c_sm->I2Cx->CMD = I2C_CMD_START;
+  i2c_sm->I2Cx->TXDATA = ((i2c_sm->deviceAddress << 1) | WRITE);
+
+  if(i2c_sm->totalCmdBytes > 0){
+      LDMA_Descriptor_t txDesc = LDMA_DESCRIPTOR_SINGLE_M2P_BYTE(i2c_sm->txBytes, &i2c_sm->I2Cx->TXDATA, i2c_sm->totalCmdBytes);
+      i2c_sm->txDesc = txDesc;
+      i2c_sm->txDesc.xfer.doneIfs = 0; // TXC or MSTOP tells the CPU the command is out
+      LDMA_StartTransfer(i2c_sm->ldmaTxCh, &txCfg, &i2c_sm->txDesc);
   }
 
 }
@@ -348,185 +511,755 @@ void NACK_Interrupt(I2C_STATE_MACHINE *i2c_sm){
 /***************************************************************************/
 /**
  * @brief
- *   RXDATAV Interrupt driver
+ *   Turns the bus around for the read part of an LDMA mode transaction
  *
  * @details
- *  This function handles the functionality of the state machine when a RXDATAV Interrupt is received by the EFM-32 from the Sensor.
- * @note
- *   This function uses switch cases to handle the different tasks of the state machine depending on the state of the state machine
+ *  Called on TXC once the command bytes are on the bus. Sends the repeated start with the read address and, for
+ *  reads of I2C_LDMA_MIN_RX_BYTES or more, hands all but the last byte to the RX channel with AUTOACK set.
+ *  Shorter reads fall back to the ACK and RXDATAV interrupts of the per byte state machine.
  *
- * @param[in] i2c pointer
- *   Pointer to the i2c peripheral being used.
+ *  The last byte is already shifting in when the RX channel takes the one before it, so clearing AUTOACK from the
+ *  done interrupt could come after it was ACKed. A second descriptor writes CTRL without AUTOACK right after the
+ *  last DMA byte instead, so the last byte waits on the bus for the NACK of i2c_receive_byte().
  *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
  *
  ******************************************************************************/
+static void i2c_ldma_read_phase(I2C_STATE_MACHINE *i2c_sm){
+
+  i2c_sm->I2Cx->IEN &= ~I2C_IEN_TXC;
+
+  if(i2c_sm->byteLefts >= I2C_LDMA_MIN_RX_BYTES && i2c_sm->byteLefts <= I2C_LDMA_MAX_RX_BYTES){
+      LDMA_TransferCfg_t rxCfg = LDMA_TRANSFER_CFG_PERIPHERAL(i2c_sm->ldmaRxSignal);
+      uint8_t *rxDst = i2c_sm->byteBuffer ? i2c_sm->byteBuffer : i2c_sm->rxBytes;
+      LDMA_Descriptor_t rxDesc = LDMA_DESCRIPTOR_LINKREL_P2M_BYTE(&i2c_sm->I2Cx->RXDATA, rxDst, i2c_sm->byteLefts - 1, 1);
+      LDMA_Descriptor_t ackDesc = LDMA_DESCRIPTOR_SINGLE_WRITE(i2c_sm->I2Cx->CTRL & ~I2C_CTRL_AUTOACK,
+                                                               &i2c_sm->I2Cx->CTRL);
+
+      i2c_sm->rxDmaBytes = i2c_sm->byteLefts - 1;
+      i2c_sm->rxDesc[0] = rxDesc;
+      i2c_sm->rxDesc[0].xfer.doneIfs = 0; // the done interrupt comes from the CTRL write
+      i2c_sm->rxDesc[1] = ackDesc;
+      i2c_sm->I2Cx->CTRL |= I2C_CTRL_AUTOACK;
+      LDMA_StartTransfer(i2c_sm->ldmaRxCh, &rxCfg, &i2c_sm->rxDesc[0]);
+  }
+  else{
+      i2c_sm->I2Cx->IEN |= I2C_IEN_ACK | I2C_IEN_RXDATAV;
+  }
 
-void RXDATAV_Interrupt(I2C_STATE_MACHINE *i2c_sm){
+  if(i2c_sm->totalCmdBytes == 0){
+      // no command phase, this is the first START of the transaction and its address is already counted
+      i2c_sm->I2Cx->CMD = I2C_CMD_START;
+      i2c_sm->I2Cx->TXDATA = i2c_sm->deviceAddress << 1 | READ;
+      i2c_sm->current_state = Hold;
+      return;
+  }
+  if(i2c_sm->stopBeforeRead){
+      i2c_sm->I2Cx->CMD = I2C_CMD_STOP;
+  }
+  i2c_sm->I2Cx->CMD = I2C_CMD_START;
+  i2c_sm->I2Cx->TXDATA = i2c_sm->deviceAddress << 1 | READ;
+  i2c_sm->current_state = Hold;
 
-    switch(i2c_sm->current_state){
-      case Init:
-              EFM_ASSERT(false);
-            break;
-          case SetReg:
-              EFM_ASSERT(false);
-            break;
-          case Hold:
-            EFM_ASSERT(false);
-            break;
+}
 
-          case RXState:
-            if(i2c_sm->read == 1){
-                *(i2c_sm->bufferAddress) = ((i2c_sm->I2Cx->RXDATA) | *i2c_sm->bufferAddress << 8);
-                    if(i2c_sm->byteLefts >= 2){
-                        i2c_sm->I2Cx->CMD = I2C_CMD_ACK;
-                        i2c_sm->byteLefts --;
+/***************************************************************************/
+/**
+ * @brief
+ *   RX channel done handler of an LDMA mode read
+ *
+ * @details
+ *  Shifts the staged bytes into the read buffer the same way i2c_receive_byte() does and leaves the last byte to
+ *  i2c_receive_byte() so it is NACKed and followed by the STOP. AUTOACK was already cleared by the last descriptor
+ *  of the channel. A byte buffer was written by the RX channel directly, so only its index moves.
+ *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
+ *
+ ******************************************************************************/
+static void i2c_ldma_rx_done(I2C_STATE_MACHINE *i2c_sm){
+  uint32_t i;
 
-                    }
-                    else{
-                         i2c_sm->I2Cx->CMD = I2C_CMD_NACK;
-                         i2c_sm->I2Cx->CMD = I2C_CMD_STOP;
-                         i2c_sm->current_state = Close;
-                    }
+  if(i2c_sm->byteBuffer){
+      i2c_sm->byteIndex += i2c_sm->rxDmaBytes;
+  }
+  else{
+      for(i = 0; i < i2c_sm->rxDmaBytes; i++){
+          *(i2c_sm->bufferAddress) = (i2c_sm->rxBytes[i] | *i2c_sm->bufferAddress << 8);
+      }
+  }
+  i2c_sm->byteLefts = 1;
+  i2c_sm->current_state = RXState;
+  i2c_sm->I2Cx->IEN |= I2C_IEN_RXDATAV;
 
-            }
-            else{
-                break;
-            }
+}
 
+/***************************************************************************/
+/**
+ * @brief
+ *   Returns the number of interrupt entries the last completed transaction of a bus took
+ *
+ * @details
+ *  I2C and LDMA interrupts are both counted, so the per byte and the LDMA transfer modes can be compared.
+ *
+ * @param[in] i2c pointer
+ *   Pointer to the base peripheral address of the i2c peripheral being used
+ *
+ ******************************************************************************/
+uint32_t i2c_get_isr_count(I2C_TypeDef *i2c){
+  return i2c_get_state_machine(i2c)->lastIsrCount;
+}
 
-            break;
+/***************************************************************************/
+/**
+ * @brief
+ *   Resets the bus and the I2C state after the bus pins were taken away
+ *
+ * @details
+ *  Used when the supply of the devices on the bus was switched back on. The bus must be idle, nothing may be on
+ *  it or queued.
+ *
+ * @param[in] i2c pointer
+ *   Pointer to the base peripheral address of the i2c peripheral being used
+ *
+ ******************************************************************************/
+void i2c_bus_reset(I2C_TypeDef *i2c){
+  EFM_ASSERT(!i2c_get_state_machine(i2c)->ifBusy);
+  i2cx_bus_reset(i2c);
+}
 
-          case Close:
-            EFM_ASSERT(false);
-            break;
-          default:
-            EFM_ASSERT(false);
-            break;
-    }
+/***************************************************************************/
+/**
+ * @brief
+ *   Sets the bus speed used for one device
+ *
+ * @details
+ *  Every transaction to the device is clocked at this speed, so a fast device is not held to the i2c_open() speed
+ *  of the bus and releases the I2C_EM_BLOCK sooner. Setting a device again replaces its speed.
+ *
+ * @note
+ *   Call after i2c_open(). I2C_SPEED_FAST_PLUS also needs HFPERCLK fast enough for the divider, and pull ups strong
+ *   enough for the 1 MHz rise time.
+ *
+ * @param[in] i2c pointer
+ *   Pointer to the base peripheral address of the i2c peripheral being used
+ *
+ * @param[in] deviceAddress
+ *   7 bit address of the device
+ *
+ * @param[in] speed
+ *   Speed profile of the device
+ *
+ ******************************************************************************/
+void i2c_set_device_speed(I2C_TypeDef *i2c, uint32_t deviceAddress, I2C_SPEED speed){
+  I2C_STATE_MACHINE *i2c_sm = i2c_get_state_machine(i2c);
+  uint32_t i;
 
+  EFM_ASSERT(speed < I2C_NUM_SPEEDS);
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  for(i = 0; i < i2c_sm->numDevices; i++){
+      if(i2c_sm->devices[i].deviceAddress == deviceAddress){
+          break;
+      }
+  }
+  if(i == i2c_sm->numDevices){
+      EFM_ASSERT(i2c_sm->numDevices < I2C_MAX_DEVICES);
+      if(i2c_sm->numDevices >= I2C_MAX_DEVICES){
+          CORE_EXIT_CRITICAL();
+          return;
+      }
+      i2c_sm->numDevices++;
+  }
+  i2c_sm->devices[i].deviceAddress = deviceAddress;
+  i2c_sm->devices[i].speed = speed;
+  CORE_EXIT_CRITICAL();
 }
 
 /***************************************************************************/
 /**
  * @brief
- *   MSTOP Interrupt driver
+ *   I2C chain start function
  *
  * @details
- *  This function handles the functionality of the state machine when a MSTOP Interrupt is received by the EFM-32 from the Sensor.
+ *  Submits a chain of steps for one device. The bus is kept for the whole chain, each step is started from the
+ *  interrupt that completed the one before it, and the callback event is scheduled once, after the last step. A
+ *  delay step gives up the EM2 block and waits on the RTCC, so the CPU sleeps between steps as well.
+ *
  * @note
- *   This function uses switch cases to handle the different tasks of the state machine depending on the state of the state machine
+ *   The steps are not copied and must stay valid until the callback event is scheduled. Individual steps do not
+ *   raise events.
  *
  * @param[in] i2c pointer
- *   Pointer to the i2c peripheral being used.
+ *   Pointer to the base peripheral address of the i2c peripheral being used
+ *
+ * @param[in] deviceAddress
+ *   7 bit address of the device every step talks to
+ *
+ * @param[in] steps, numSteps
+ *   The chain
  *
+ * @param[in] callback
+ *   Event scheduled when the chain completes
+ *
+ * @param[in] hook
+ *   Called from the interrupt that ends the chain, completed or abandoned, 0 for none. It can take the read results
+ *   before the next transaction on the bus reuses their buffers.
+ *
+ * @return
+ *   false if the bus queue was full and the chain was dropped
  *
  ******************************************************************************/
+bool i2c_start_chain(I2C_TypeDef *i2c, uint32_t deviceAddress, const I2C_CHAIN_STEP *steps, uint32_t numSteps, uint32_t callback,
+                     I2C_CHAIN_HOOK hook){
+  STATE_MACHINE_START_STRUCT chainStart;
+
+  EFM_ASSERT(numSteps > 0);
+
+  chainStart.newDeviceAddress = deviceAddress;
+  chainStart.newChain = steps;
+  chainStart.newChainSteps = numSteps;
+  chainStart.newChainHook = hook;
+  chainStart.newCallBack = callback;
+  chainStart.newBufferAddress = 0;
+  chainStart.newRead = false;
+  chainStart.newBytesleft = 0;
+  chainStart.newCommand = 0;
+  chainStart.newNumCmdBytes = 0;
+  chainStart.newCombinedBytes = 0;
+  chainStart.newData = 0;
+  chainStart.newRegisterAddress = 0;
+  chainStart.newRepeatedStart = 0;
+  chainStart.newByteBuffer = 0;
+  chainStart.newStopBeforeRead = false;
+
+  return i2c_start(i2c, &chainStart);
+}
 
-void MSTOP_Interrupt(I2C_STATE_MACHINE *i2c_sm){
-  switch(i2c_sm->current_state){
-        case Init:
-          EFM_ASSERT(false);
-          break;
-        case SetReg:
-          EFM_ASSERT(false);
-          break;
-        case Hold:
-          EFM_ASSERT(false);
-          break;
-        case RXState:
-          EFM_ASSERT(false);
+/***************************************************************************/
+/**
+ * @brief
+ *   Starts the current step of the chain owning the bus
+ *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
+ *
+ ******************************************************************************/
+static void i2c_chain_step(I2C_STATE_MACHINE *i2c_sm){
+  const I2C_CHAIN_STEP *step = &i2c_sm->chain[i2c_sm->chainIndex];
+  STATE_MACHINE_START_STRUCT stepStart;
+
+  if(step->type == I2C_STEP_DELAY){
+      sleep_unblock_mode(I2C_EM_BLOCK);
+      rtcc_timer_start(&i2c_sm->timer, step->delayMs, 0, i2c_chain_delay_done, i2c_sm);
+      return;
+  }
 
-          break;
-        case Close:
-          if(i2c_sm->read == 1){
-              add_scheduled_events(i2c_sm->I2C_CallBackEvent);
-              sleep_unblock_mode(I2C_EM_BLOCK);
-              i2c_sm->ifBusy = false;
-          }
-          if(i2c_sm->read == 0){
-              sleep_unblock_mode(I2C_EM_BLOCK);
-              i2c_sm->ifBusy = false;
-          }
-          break;
-        default:
-          EFM_ASSERT(false);
-          break;
+  stepStart.newDeviceAddress = i2c_sm->deviceAddress;
+  stepStart.newRead = (step->type == I2C_STEP_READ);
+  stepStart.newCommand = step->command;
+  stepStart.newNumCmdBytes = step->numCmdBytes;
+  stepStart.newBufferAddress = step->bufferAddress;
+  stepStart.newBytesleft = step->bytes;
+  stepStart.newCombinedBytes = step->numCmdBytes + step->bytes;
+  stepStart.newCallBack = 0;
+  stepStart.newData = 0;
+  stepStart.newRegisterAddress = 0;
+  stepStart.newRepeatedStart = 0;
+  stepStart.newChain = 0;
+  stepStart.newChainSteps = 0;
+  stepStart.newChainHook = 0;
+  stepStart.newByteBuffer = step->byteBuffer;
+  stepStart.newStopBeforeRead = step->stopBeforeRead;
+
+  i2c_begin_transaction(i2c_sm, &stepStart);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Moves the chain owning the bus to its next step
+ *
+ * @return
+ *   true if a step was started, false if the chain is complete, its hook was called and its callback event was
+ *   scheduled
+ *
+ ******************************************************************************/
+static bool i2c_chain_next(I2C_STATE_MACHINE *i2c_sm){
+  i2c_sm->chainIndex++;
+  if(i2c_sm->chainIndex < i2c_sm->chainSteps){
+      i2c_chain_step(i2c_sm);
+      return true;
+  }
+  i2c_sm->chain = 0;
+  if(i2c_sm->chainHook){
+      i2c_sm->chainHook(true);
   }
+  add_scheduled_events(i2c_sm->chainCallBack);
+  return false;
 }
 
+/***************************************************************************/
+/**
+ * @brief
+ *   RTCC callback ending a delay step
+ *
+ * @param[in] arg
+ *   Pointer to the state machine of the bus
+ *
+ ******************************************************************************/
+static void i2c_chain_delay_done(void *arg){
+  I2C_STATE_MACHINE *i2c_sm = (I2C_STATE_MACHINE *)arg;
+
+  sleep_block_mode(I2C_EM_BLOCK);
+  if(!i2c_chain_next(i2c_sm)){
+      i2c_next_or_idle(i2c_sm);
+  }
+}
 
 /***************************************************************************/
 /**
  * @brief
- * I2C0 Interrupt Handler function
+ *   Hands the bus to the next queued transaction, or releases it
  *
- * @details
- * This function determines the interrupt flags that are both raised and enabled, and then calls the corresponding Interrupt driver in order to progress through the
- * state machine
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
  *
+ ******************************************************************************/
+static void i2c_next_or_idle(I2C_STATE_MACHINE *i2c_sm){
+  if(i2c_sm->queueCount > 0){
+      // keep the bus and the energy mode block, and start the next queued transaction from here
+      STATE_MACHINE_START_STRUCT *next = &i2c_sm->queue[i2c_sm->queueHead];
+      i2c_sm->queueHead = (i2c_sm->queueHead + 1) % I2C_QUEUE_SIZE;
+      i2c_sm->queueCount--;
+      i2c_begin_transaction(i2c_sm, next);
+  }
+  else{
+      sleep_unblock_mode(I2C_EM_BLOCK);
+      i2c_sm->ifBusy = false;
+  }
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   State machine actions
  *
- * @param[in] void
+ * @details
+ *   Each action is one cell of i2c_transition_table, the reaction of a state to one interrupt event. They are only
+ *   called from i2c_irq_handler().
  *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
  *
  ******************************************************************************/
+static void i2c_unexpected(I2C_STATE_MACHINE *i2c_sm){
+  (void)i2c_sm;
+  EFM_ASSERT(false);
+}
 
-void I2C0_IRQHandler(void){
+static void i2c_ignore(I2C_STATE_MACHINE *i2c_sm){
+  // a stopBeforeRead read address is sent after a STOP, and that STOP raises MSTOP in Hold
+  (void)i2c_sm;
+}
 
-  int int_flag;
-  int_flag = (I2C0->IF & I2C0->IEN);
-  I2C0->IFC = int_flag;
+static void i2c_send_stop(I2C_STATE_MACHINE *i2c_sm){
+  i2c_sm->I2Cx->CMD = I2C_CMD_STOP;
+  i2c_sm->current_state = Close;
+}
 
-if(int_flag & I2C_IF_ACK){
-    ACK_Interrupt(&i2c0);
+static void i2c_send_read_address(I2C_STATE_MACHINE *i2c_sm){
+  if(i2c_sm->stopBeforeRead){
+      i2c_sm->I2Cx->CMD = I2C_CMD_STOP;
+  }
+  i2c_sm->I2Cx->CMD = I2C_CMD_START;
+  i2c_sm->I2Cx->TXDATA = i2c_sm->deviceAddress << 1 | READ;
+  i2c_sm->current_state = Hold;
 }
-if(int_flag & I2C_IF_NACK){
-    NACK_Interrupt(&i2c0);
+
+static void i2c_send_command(I2C_STATE_MACHINE *i2c_sm){
+  if(i2c_sm->numCmdBytes == 0){
+      // nothing (left) to send after the address
+      if(i2c_sm->read == true){
+          i2c_send_read_address(i2c_sm);
+      }
+      else{
+          i2c_send_stop(i2c_sm);
+      }
+      return;
+  }
+  i2c_sm->numCmdBytes--;
+  i2c_sm->I2Cx->TXDATA = (i2c_sm->command) >> (8*(i2c_sm->numCmdBytes));
+  if(i2c_sm->numCmdBytes == 0){
+      if(i2c_sm->read == false){
+          i2c_sm->current_state = Write;
+      }
+      else{
+          i2c_sm->current_state = SetReg;
+      }
+  }
 }
-if(int_flag & I2C_IF_RXDATAV){
-    RXDATAV_Interrupt(&i2c0);
+
+static void i2c_enter_rx(I2C_STATE_MACHINE *i2c_sm){
+  i2c_sm->current_state = RXState;
 }
-if(int_flag & I2C_IF_MSTOP){
-    MSTOP_Interrupt(&i2c0);
-    }
 
+static bool i2c_nack_retry(I2C_STATE_MACHINE *i2c_sm){
+  // a NACK is retried at most I2C_MAX_NACK_RETRIES times, then the transaction is stopped and completes on MSTOP
+  if(i2c_sm->nackRetries < I2C_MAX_NACK_RETRIES){
+      i2c_sm->nackRetries++;
+      I2C_SM_TRACE(i2c_sm, I2C_TRACE_NACK, i2c_sm->nackRetries);
+      return true;
+  }
+  i2c_sm->failed = true;
+  if(i2c_sm->ldmaActive){
+      LDMA_StopTransfer(i2c_sm->ldmaTxCh);
+      LDMA_StopTransfer(i2c_sm->ldmaRxCh);
+      i2c_sm->I2Cx->CMD = I2C_CMD_CLEARTX;
+  }
+  i2c_sm->I2Cx->CTRL &= ~(I2C_CTRL_AUTOACK | I2C_CTRL_AUTOSE);
+  i2c_sm->I2Cx->IEN = I2C_IEN_MSTOP;
+  i2c_send_stop(i2c_sm);
+  return false;
 }
 
+static void i2c_restart(I2C_STATE_MACHINE *i2c_sm){
+  // address or command refused, send the whole command again, a NACK on the last command byte included
+  if(!i2c_nack_retry(i2c_sm)){
+      return;
+  }
+  if(i2c_sm->ldmaActive){
+      LDMA_StopTransfer(i2c_sm->ldmaTxCh);
+      i2c_sm->I2Cx->CMD = I2C_CMD_CLEARTX;
+      i2c_ldma_begin(i2c_sm);
+      return;
+  }
+  EFM_ASSERT(i2c_sm->current_state == Init || i2c_sm->current_state == SetReg || i2c_sm->current_state == Write);
+  i2c_sm->current_state = Init;
+  i2c_sm->I2Cx->CMD = I2C_CMD_START;
+  i2c_sm->I2Cx->TXDATA = (i2c_sm->deviceAddress << 1 | WRITE);
+  i2c_sm->numCmdBytes = i2c_sm->totalCmdBytes;
+}
+
+static void i2c_close_nack(I2C_STATE_MACHINE *i2c_sm){
+  // an LDMA write is in Close while its command bytes go out, a per byte write only gets there after the last ACK
+  if(i2c_sm->ldmaActive){
+      i2c_restart(i2c_sm);
+      return;
+  }
+  i2c_unexpected(i2c_sm);
+}
+
+static void i2c_resend_read_address(I2C_STATE_MACHINE *i2c_sm){
+  // the device is still converting, ask again
+  if(!i2c_nack_retry(i2c_sm)){
+      return;
+  }
+  i2c_send_read_address(i2c_sm);
+}
+
+static void i2c_store_byte(I2C_STATE_MACHINE *i2c_sm, uint8_t byte){
+  if(i2c_sm->byteBuffer){
+      i2c_sm->byteBuffer[i2c_sm->byteIndex++] = byte;
+  }
+  else{
+      *(i2c_sm->bufferAddress) = (byte | *i2c_sm->bufferAddress << 8);
+  }
+}
+
+static void i2c_receive_byte(I2C_STATE_MACHINE *i2c_sm){
+  i2c_store_byte(i2c_sm, i2c_sm->I2Cx->RXDATA);
+  if(i2c_sm->byteLefts >= 2){
+      i2c_sm->I2Cx->CMD = I2C_CMD_ACK;
+      i2c_sm->byteLefts --;
+  }
+  else{
+      i2c_sm->I2Cx->CMD = I2C_CMD_NACK;
+      i2c_sm->I2Cx->CMD = I2C_CMD_STOP;
+      i2c_sm->current_state = Close;
+  }
+}
+
+static void i2c_complete(I2C_STATE_MACHINE *i2c_sm){
+  rtcc_timer_stop(&i2c_sm->timer);
+  I2C_SM_TRACE(i2c_sm, I2C_TRACE_COMPLETE, i2c_sm->isrCount);
+  i2c_sm->lastIsrCount = i2c_sm->isrCount;
+  if(i2c_sm->failed){
+      i2c_fail(i2c_sm);
+      return;
+  }
+  add_scheduled_events(i2c_sm->I2C_CallBackEvent);
+  if(i2c_sm->chain && i2c_chain_next(i2c_sm)){
+      return;
+  }
+  i2c_next_or_idle(i2c_sm);
+}
+
+
 /***************************************************************************/
 /**
  * @brief
- * I2C1 Interrupt Handler function
+ *   Ends the failed transaction on the bus
  *
  * @details
- * This function determines the interrupt flags that are both raised and enabled, and then calls the corresponding Interrupt driver in order to progress through the
- * state machine
+ *  Schedules the error callback of the bus instead of the callback of the transaction. A chain is abandoned, its
+ *  remaining steps are not run, its hook is told so and its callback is not scheduled. The bus then moves on to its queue.
  *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
  *
- * @param[in] void
+ ******************************************************************************/
+static void i2c_fail(I2C_STATE_MACHINE *i2c_sm){
+  I2C_SM_TRACE(i2c_sm, I2C_TRACE_FAIL, i2c_sm->deviceAddress);
+  if(i2c_sm->chain && i2c_sm->chainHook){
+      i2c_sm->chainHook(false);
+  }
+  i2c_sm->chain = 0;
+  add_scheduled_events(i2c_sm->errorCallBack);
+  i2c_next_or_idle(i2c_sm);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   RTCC callback of a transaction that missed its deadline
  *
+ * @details
+ *  Aborts the transaction, hands SCL and SDA to the GPIO and starts clocking the bus from the RTCC with
+ *  i2c_recovery_clock(). Nothing here waits on the bus, the CPU may sleep between the recovery clocks.
+ *  A timeout during the recovery itself gives up on the bus and finishes the recovery as it is.
+ *
+ * @param[in] arg
+ *   Pointer to the state machine of the bus
  *
  ******************************************************************************/
-void I2C1_IRQHandler(void){
+static void i2c_timeout(void *arg){
+  I2C_STATE_MACHINE *i2c_sm = (I2C_STATE_MACHINE *)arg;
 
-  int int_flag;
-  int_flag = (I2C1->IF & I2C1->IEN);
-  I2C1->IFC = int_flag;
+  if(i2c_sm->current_state == Recovery){
+      i2c_recovery_finish(i2c_sm);
+      return;
+  }
 
-if(int_flag == I2C_IF_ACK){
-    ACK_Interrupt(&i2c1);
+  I2C_SM_TRACE(i2c_sm, I2C_TRACE_TIMEOUT, i2c_sm->isrCount);
+  i2c_sm->failed = true;
+  i2c_sm->recoveryClocks = 0;
+  i2c_sm->current_state = Recovery;
+
+  if(i2c_sm->ldmaActive){
+      LDMA_StopTransfer(i2c_sm->ldmaTxCh);
+      LDMA_StopTransfer(i2c_sm->ldmaRxCh);
+  }
+  i2c_sm->I2Cx->IEN = 0;
+  i2c_sm->I2Cx->CTRL &= ~(I2C_CTRL_AUTOACK | I2C_CTRL_AUTOSE);
+  i2c_sm->I2Cx->CMD = I2C_CMD_ABORT | I2C_CMD_CLEARTX;
+  i2c_sm->I2Cx->IFC = _I2C_IF_MASK;
+
+  // the pins are wired-and with their GPIO output set, releasing the route leaves both lines pulled high
+  i2c_sm->routePen = i2c_sm->I2Cx->ROUTEPEN;
+  GPIO_PinOutSet(i2c_sm->sclPort, i2c_sm->sclPin);
+  GPIO_PinOutSet(i2c_sm->sdaPort, i2c_sm->sdaPin);
+  i2c_sm->I2Cx->ROUTEPEN = 0;
+
+  i2c_recovery_clock(i2c_sm);
 }
-if(int_flag == I2C_IF_NACK){
-    NACK_Interrupt(&i2c1);
+
+/***************************************************************************/
+/**
+ * @brief
+ *   One half period of the recovery clocks
+ *
+ * @details
+ *  Toggles SCL every I2C_RECOVERY_HALF_MS from the RTCC until the slave releases SDA while SCL is high or
+ *  I2C_RECOVERY_CLOCKS pulses were sent. The route is then given back to the I2C, and a START and STOP from the
+ *  peripheral resets the slaves. Its MSTOP finishes the recovery through the transition table.
+ *
+ * @param[in] arg
+ *   Pointer to the state machine of the bus
+ *
+ ******************************************************************************/
+static void i2c_recovery_clock(void *arg){
+  I2C_STATE_MACHINE *i2c_sm = (I2C_STATE_MACHINE *)arg;
+
+  if(GPIO_PinOutGet(i2c_sm->sclPort, i2c_sm->sclPin)){
+      if(GPIO_PinInGet(i2c_sm->sdaPort, i2c_sm->sdaPin) || i2c_sm->recoveryClocks >= I2C_RECOVERY_CLOCKS){
+          i2c_sm->I2Cx->ROUTEPEN = i2c_sm->routePen;
+          i2c_sm->I2Cx->CMD = I2C_CMD_ABORT;
+          i2c_sm->I2Cx->IFC = _I2C_IF_MASK;
+          i2c_sm->I2Cx->IEN = I2C_IEN_MSTOP;
+          i2c_sm->I2Cx->CMD = I2C_CMD_START | I2C_CMD_STOP;
+          rtcc_timer_start(&i2c_sm->timer, I2C_TIMEOUT_MS, 0, i2c_timeout, i2c_sm);
+          return;
+      }
+      GPIO_PinOutClear(i2c_sm->sclPort, i2c_sm->sclPin);
+      i2c_sm->recoveryClocks++;
+  }
+  else{
+      GPIO_PinOutSet(i2c_sm->sclPort, i2c_sm->sclPin);
+  }
+  rtcc_timer_start(&i2c_sm->timer, I2C_RECOVERY_HALF_MS, 0, i2c_recovery_clock, i2c_sm);
 }
-if(int_flag == I2C_IF_RXDATAV){
-    RXDATAV_Interrupt(&i2c1);
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Ends a bus recovery
+ *
+ * @details
+ *  Re-initializes the peripheral by disabling it and aborting whatever it still holds, then fails the timed out
+ *  transaction so the bus can move on to its queue.
+ *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
+ *
+ ******************************************************************************/
+static void i2c_recovery_finish(I2C_STATE_MACHINE *i2c_sm){
+  rtcc_timer_stop(&i2c_sm->timer);
+  i2c_sm->I2Cx->IEN = 0;
+  I2C_Enable(i2c_sm->I2Cx, false);
+  I2C_Enable(i2c_sm->I2Cx, true);
+  i2c_sm->I2Cx->CMD = I2C_CMD_ABORT;
+  i2c_sm->I2Cx->IFC = _I2C_IF_MASK;
+  i2c_sm->I2Cx->ROUTEPEN = i2c_sm->routePen;
+  i2c_sm->current_state = Init;
+  i2c_fail(i2c_sm);
 }
-if(int_flag == I2C_IF_MSTOP){
-    MSTOP_Interrupt(&i2c1);
-    }
+
+
+/*
+ * (state x event) transition table of the interrupt driven state machine.
+ * Every bus runs through this table from i2c_irq_handler(), so the cost of an interrupt is one lookup per pending
+ * flag regardless of the state, and a new state or event is one more row or column.
+ */
+static const I2C_ACTION i2c_transition_table[I2C_NUM_STATES][I2C_NUM_EVENTS] = {
+  /*               TXC                   ACK                     NACK                      RXDATAV            MSTOP         */
+  /* Init    */ { i2c_ldma_read_phase,  i2c_send_command,       i2c_restart,              i2c_unexpected,    i2c_unexpected },
+  /* SetReg  */ { i2c_unexpected,       i2c_send_read_address,  i2c_restart,              i2c_unexpected,    i2c_unexpected },
+  /* Hold    */ { i2c_unexpected,       i2c_enter_rx,           i2c_resend_read_address,  i2c_unexpected,    i2c_ignore     },
+  /* Write   */ { i2c_unexpected,       i2c_send_stop,          i2c_restart,              i2c_unexpected,    i2c_unexpected },
+  /* RXState */ { i2c_unexpected,       i2c_unexpected,         i2c_unexpected,           i2c_receive_byte,  i2c_unexpected },
+  /* Close   */ { i2c_unexpected,       i2c_unexpected,         i2c_close_nack,           i2c_unexpected,    i2c_complete   },
+  /* Recovery*/ { i2c_unexpected,       i2c_unexpected,         i2c_unexpected,           i2c_unexpected,    i2c_recovery_finish },
+};
+
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Returns the state machine of a bus
+ *
+ * @details
+ *   The I2C peripherals are evenly spaced in the memory map, so the instance is found from the base address
+ *   instead of comparing against every bus.
+ *
+ * @param[in] i2c pointer
+ *   Pointer to the base peripheral address of the i2c peripheral being used
+ *
+ ******************************************************************************/
+static I2C_STATE_MACHINE *i2c_get_state_machine(I2C_TypeDef *i2c){
+  uint32_t instance = I2C_INSTANCE(i2c);
+
+  EFM_ASSERT(instance < I2C_NUM_INSTANCES);
+  return &i2c_state_machines[instance];
 }
 
+/***************************************************************************/
+/**
+ * @brief
+ *   Interrupt handler shared by all the I2C buses
+ *
+ * @details
+ *  Clears the interrupt flags that are both raised and enabled, then runs the transition table entry of the current
+ *  state for each of them. Flags raised together are all handled, in I2C_EVENT order.
+ *
+ * @param[in] i2c_sm
+ *   Pointer to the state machine of the bus
+ *
+ ******************************************************************************/
+static void i2c_irq_handler(I2C_STATE_MACHINE *i2c_sm){
+  uint32_t int_flag;
+  uint32_t event;
+  DEFINED_STATES previous;
+
+  int_flag = (i2c_sm->I2Cx->IF & i2c_sm->I2Cx->IEN);
+  i2c_sm->I2Cx->IFC = int_flag;
+  i2c_sm->isrCount++;
+  I2C_SM_TRACE(i2c_sm, I2C_TRACE_IRQ, int_flag);
+
+  for(event = 0; event < I2C_NUM_EVENTS; event++){
+      if(int_flag & i2c_event_flag[event]){
+          previous = i2c_sm->current_state;
+          i2c_transition_table[i2c_sm->current_state][event](i2c_sm);
+          if(i2c_sm->current_state != previous){
+              I2C_SM_TRACE(i2c_sm, I2C_TRACE_STATE, previous);
+          }
+      }
+  }
+}
 
 
+/***************************************************************************/
+/**
+ * @brief
+ * I2C0 Interrupt Handler function
+ *
+ * @param[in] void
+ *
+ ******************************************************************************/
 
+void I2C0_IRQHandler(void){
+  PROFILE_START(PROFILE_I2C0_IRQ);
+  i2c_irq_handler(&i2c_state_machines[0]);
+  PROFILE_STOP(PROFILE_I2C0_IRQ);
+}
 
+/***************************************************************************/
+/**
+ * @brief
+ * I2C1 Interrupt Handler function
+ *
+ * @param[in] void
+ *
+ ******************************************************************************/
+void I2C1_IRQHandler(void){
+  PROFILE_START(PROFILE_I2C1_IRQ);
+  i2c_irq_handler(&i2c_state_machines[1]);
+  PROFILE_STOP(PROFILE_I2C1_IRQ);
+}
 
+/***************************************************************************/
+/**
+ * @brief
+ * LDMA Interrupt Handler function
+ *
+ * @details
+ * Only the RX channels of the I2C buses raise done interrupts. The TX channels finish silently and the I2C TXC or
+ * MSTOP interrupt takes over.
+ *
+ *
+ * @param[in] void
+ *
+ *
+ ******************************************************************************/
+void LDMA_IRQHandler(void){
+
+  uint32_t int_flag;
+  PROFILE_START(PROFILE_LDMA_IRQ);
+  int_flag = (LDMA->IF & LDMA->IEN);
+  LDMA->IFC = int_flag;
+
+  EFM_ASSERT(!(int_flag & LDMA_IF_ERROR));
+
+  for(uint32_t i = 0; i < I2C_NUM_INSTANCES; i++){
+      I2C_STATE_MACHINE *i2c_sm = &i2c_state_machines[i];
+      if(int_flag & (1 << i2c_instance_config[i].ldmaRxCh)){
+          i2c_sm->isrCount++;
+          I2C_SM_TRACE(i2c_sm, I2C_TRACE_IRQ, int_flag);
+          i2c_ldma_rx_done(i2c_sm);
+          I2C_SM_TRACE(i2c_sm, I2C_TRACE_STATE, Hold);
+      }
+  }
+  PROFILE_STOP(PROFILE_LDMA_IRQ);
+}
@@ -12,7 +12,135 @@
 #include "SHTC3.h"
 
 
-uint64_t SH_data = 0;
+// reply of a measurement in bus order: T msb, T lsb, T CRC, RH msb, RH lsb, RH CRC
+// owned by the bus, shtc3_chain_done() hands it to the main loop as a SAMPLE_RECORD
+static uint8_t SH_data[SHTC3_FRAME_BYTES];
+static volatile uint32_t shtc3_crc_errors; // words that failed their CRC, counted in the I2C interrupt
+static volatile SHTC3_PRECISION shtc3_precision = SHTC3_NORMAL; // mode of the next measurement
+static bool shtc3_have_last; // a previous sample exists to compare against
+static int32_t shtc3_last_temp;
+static int32_t shtc3_last_rh;
+static int32_t shtc3_rh_alert = SHTC3_NO_ALERT; // humidity the application alerts on, centi-percent RH
+static bool shtc3_keep_awake = false; // leave the sensor idle between samples instead of putting it to sleep
+
+// wake, wait out the wakeup time, start the measurement and sleep through it, read, then put the sensor back to
+// sleep, all from the I2C interrupts
+// a sensor kept awake runs only the measure, delay and read steps
+// one chain per precision so a chain already queued on the bus is never changed under it
+#define SHTC3_MEASURE_CHAIN_STEPS   6
+static const I2C_CHAIN_STEP shtc3_measure_chain[SHTC3_NUM_PRECISIONS][SHTC3_MEASURE_CHAIN_STEPS] = {
+    [SHTC3_NORMAL] = {
+        { I2C_STEP_WRITE, SHTC3_wakeup_cmd, twoByte, 0, 0, 0, 0, false },
+        { I2C_STEP_DELAY, 0, 0, 0, 0, SHTC3_WAKEUP_MS, 0, false },
+        { I2C_STEP_WRITE, tempFirstReadCmd, twoByte, 0, 0, 0, 0, false },
+        { I2C_STEP_DELAY, 0, 0, 0, 0, SHTC3_MEASURE_MS, 0, false },
+        { I2C_STEP_READ, 0, 0, 0, SHTC3_FRAME_BYTES, 0, SH_data, true },
+        { I2C_STEP_WRITE, SHTC3_sleep_cmd, twoByte, 0, 0, 0, 0, false },
+    },
+    [SHTC3_LOW_POWER] = {
+        { I2C_STEP_WRITE, SHTC3_wakeup_cmd, twoByte, 0, 0, 0, 0, false },
+        { I2C_STEP_DELAY, 0, 0, 0, 0, SHTC3_WAKEUP_MS, 0, false },
+        { I2C_STEP_WRITE, tempFirstReadCmdLP, twoByte, 0, 0, 0, 0, false },
+        { I2C_STEP_DELAY, 0, 0, 0, 0, SHTC3_MEASURE_LP_MS, 0, false },
+        { I2C_STEP_READ, 0, 0, 0, SHTC3_FRAME_BYTES, 0, SH_data, true },
+        { I2C_STEP_WRITE, SHTC3_sleep_cmd, twoByte, 0, 0, 0, 0, false },
+    },
+};
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Raw word at a frame offset, after checking its CRC
+ *
+ * @param[in] offset
+ *  SHTC3_TEMP_WORD or SHTC3_RH_WORD
+ *
+ * @param[out] word
+ *  The word, most significant byte first on the bus
+ *
+ * @return
+ *  false if the word failed its CRC
+ *
+ ******************************************************************************/
+static bool shtc3_frame_word(uint32_t offset, uint16_t *word){
+  *word = (uint16_t)((uint32_t)SH_data[offset] << 8 | SH_data[offset + 1]);
+  if(crc8_compute(&SH_data[offset], 2) != SH_data[offset + 2]){
+      shtc3_crc_errors++;
+      return false;
+  }
+  return true;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Hook of the measurement chains
+ *
+ * @details
+ *  Runs in the I2C interrupt that ends the chain. Both words of the frame are checked against their CRC and posted
+ *  to the SENSOR_SHTC3 sample queue before the next transaction on the bus can overwrite SH_data. A corrupt frame
+ *  puts the sensor back in normal mode, so a repeated measurement is taken at full precision. An abandoned chain
+ *  posts a SAMPLE_BUS_ERROR record.
+ *
+ * @param[in] ok
+ *  false if the chain was abandoned on a failure
+ *
+ ******************************************************************************/
+static void shtc3_chain_done(bool ok){
+  SAMPLE_RECORD record;
+  bool temp_ok;
+  bool rh_ok;
+
+  record.timestamp = rtcc_get_count();
+  record.sensor = SENSOR_SHTC3;
+  record.rawTemp = 0;
+  record.rawRh = 0;
+  if(!ok){
+      record.status = SAMPLE_BUS_ERROR;
+  }
+  else{
+      temp_ok = shtc3_frame_word(SHTC3_TEMP_WORD, &record.rawTemp);
+      rh_ok = shtc3_frame_word(SHTC3_RH_WORD, &record.rawRh);
+      record.status = (temp_ok && rh_ok) ? SAMPLE_OK : SAMPLE_CRC_ERROR;
+      if(record.status == SAMPLE_CRC_ERROR){
+          shtc3_precision = SHTC3_NORMAL;
+      }
+  }
+  sample_queue_post(&record);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Picks the precision of the next measurement from the sample just read
+ *
+ * @details
+ *  Low power mode is only used while both readings moved less than SHTC3_STABLE_TEMP_CENTI and
+ *  SHTC3_STABLE_RH_CENTI since the last sample and the humidity is more than CONV_ALERT_BAND_CENTI away from the
+ *  alert threshold. Anything else, including the first sample, measures in normal mode, so a change seen by a low power
+ *  sample is followed by a full precision one.
+ *
+ * @param[in] temp
+ *  Temperature just read in centi-degrees Celsius
+ *
+ * @param[in] rh
+ *  Humidity just read in centi-percent RH
+ *
+ ******************************************************************************/
+static void shtc3_select_precision(int32_t temp, int32_t rh){
+  bool stable;
+  bool near_alert;
+
+  stable = shtc3_have_last
+      && conv_abs_diff(temp, shtc3_last_temp) < SHTC3_STABLE_TEMP_CENTI
+      && conv_abs_diff(rh, shtc3_last_rh) < SHTC3_STABLE_RH_CENTI;
+  near_alert = (shtc3_rh_alert != SHTC3_NO_ALERT) && conv_abs_diff(rh, shtc3_rh_alert) <= CONV_ALERT_BAND_CENTI;
+
+  shtc3_precision = (stable && !near_alert) ? SHTC3_LOW_POWER : SHTC3_NORMAL;
+  shtc3_last_temp = temp;
+  shtc3_last_rh = rh;
+  shtc3_have_last = true;
+}
 /***************************************************************************/
 /**
  * @brief
@@ -37,7 +165,8 @@ void SH_read_helper(uint32_t callback, uint32_t bytes, uint32_t numCmdBytes, uin
 
   STATE_MACHINE_START_STRUCT SH_start;
 
-  SH_start.newBufferAddress = &SH_data;
+  SH_start.newBufferAddress = 0;
+  SH_start.newByteBuffer = SH_data;
   SH_start.newBytesleft = bytes;
   SH_start.newNumCmdBytes = numCmdBytes;
   SH_start.newCallBack = callback;
@@ -45,6 +174,11 @@ void SH_read_helper(uint32_t callback, uint32_t bytes, uint32_t numCmdBytes, uin
   SH_start.newCommand = command;
   SH_start.newDeviceAddress = SH_address;
   SH_start.newRead = true;
+  SH_start.newStopBeforeRead = true; // the SHTC3 takes no repeated start
+  SH_start.newData = 0;
+  SH_start.newRepeatedStart = 0;
+  SH_start.newChain = 0;
+  SH_start.newCombinedBytes = numCmdBytes + bytes;
 
 
   i2c_start(SH_I2C, &SH_start);
@@ -76,14 +210,20 @@ void SH_write_helper(uint32_t command, uint32_t numCmdBytes, uint32_t callback){
 
   STATE_MACHINE_START_STRUCT SH_start;
 
-  SH_start.newBufferAddress = &SH_data;
+  SH_start.newBufferAddress = 0;
+  SH_start.newByteBuffer = 0;
   SH_start.newNumCmdBytes = numCmdBytes;
   SH_start.newCallBack = callback;
 //  SH_start.newCombinedBytes = SH_start.newNumCmdBytes + SH_start.newBytesleft;
   SH_start.newCommand = command;
   SH_start.newDeviceAddress = SH_address;
   SH_start.newRead = false;
+  SH_start.newStopBeforeRead = false;
   SH_start.newData = 0;
+  SH_start.newBytesleft = 0;
+  SH_start.newRepeatedStart = 0;
+  SH_start.newChain = 0;
+  SH_start.newCombinedBytes = numCmdBytes;
 
   i2c_start(SH_I2C, &SH_start);
 
@@ -99,11 +239,14 @@ void SH_write_helper(uint32_t command, uint32_t numCmdBytes, uint32_t callback){
  *
  * @note  At the end of the function it calls i2c_open with the values we intialized in our i2c_open_struct
  *
+ * @param[in] error_cb
+ * Event scheduled when a transaction with the sensor fails
+ *
  *
  *
  ******************************************************************************/
 
-void SH_I2C_open(){
+void SH_I2C_open(uint32_t error_cb){
   I2C_OPEN_STRUCT_TypeDef SH_open;
 
   SH_open.ROUTEscl = SH_SCL_Route;
@@ -115,10 +258,18 @@ void SH_I2C_open(){
   SH_open.refFreq = 0;
   SH_open.scl_pin_en = true;
   SH_open.sda_pin_en = true;
+  SH_open.ldma_en = SHTC3_LDMA_EN;
+  SH_open.error_cb = error_cb;
+  SH_open.scl_port = SH_SCL_Port;
+  SH_open.scl_pin = SH_SCL_Pin;
+  SH_open.sda_port = SH_SDA_Port;
+  SH_open.sda_pin = SH_SDA_Pin;
 
   timer_delay(SHTC3_Delay);
 
+  crc8_open();
   i2c_open(SH_I2C, &SH_open);
+  i2c_set_device_speed(SH_I2C, SH_address, SHTC3_SPEED);
 }
 
 /***************************************************************************/
@@ -127,115 +278,163 @@ void SH_I2C_open(){
  *  shtc3_read_data_crc is used to intialize a write, read, and then another write to the SHTC3 sensor
  *
  * @details
- *  It completes this task by calling the read and write helper functions with various different inputs
+ *  It completes this task by submitting shtc3_measure_chain, so the wakeup and measurement delays and the transactions run
+ *  from interrupt context and only the callback event wakes the main loop. The chain of the precision picked by the
+ *  last sample is used, without the wakeup and sleep commands while the sensor is kept awake. The frame is posted to
+ *  the SENSOR_SHTC3 sample queue with its CRC status.
  * @note
  *
  * @param[in] callback
  * The input parameter is the call back event
  *
+ * @return
+ *  false if the bus queue was full and the chain was not submitted, no frame is posted then
  *
  ******************************************************************************/
 
-void shtc3_read_data_and_crc(uint32_t callback_event){
-  SH_write_helper(SHTC3_wakeup_cmd, twoByte,0);
-  SH_read_helper(0, twoByte, sixByte, tempFirstReadCmd);
-  SH_write_helper(SHTC3_sleep_cmd, twoByte, callback_event);
+bool shtc3_read_data_and_crc(uint32_t callback_event){
+  if(shtc3_keep_awake){
+      return i2c_start_chain(SH_I2C, SH_address, &shtc3_measure_chain[shtc3_precision][SHTC3_AWAKE_FIRST_STEP],
+                             SHTC3_AWAKE_CHAIN_STEPS, callback_event, shtc3_chain_done);
+  }
+  return i2c_start_chain(SH_I2C, SH_address, shtc3_measure_chain[shtc3_precision], SHTC3_MEASURE_CHAIN_STEPS,
+                         callback_event, shtc3_chain_done);
+}
 
+/***************************************************************************/
+/**
+ * @brief
+ *  Number of measurement words that failed their CRC since reset
+ *
+ ******************************************************************************/
+uint32_t shtc3_get_crc_errors(void){
+  return shtc3_crc_errors;
 }
 
 /***************************************************************************/
 /**
  * @brief
- *  Helper function to calculate the temp from he raw data we got from the sensor
+ *  Helper function that returns the temperature and humidity so that the application layer can see them.
  *
 
- * @note This function returns the temperature in farenheight.
+ * @note This function returns the temperature in centi-degrees Celsius and humidity in centi-percent RH of a
+ *  SAMPLE_OK record. It only converts, the sample is handed to shtc3_sample_done() once it is used.
  *
 
  *
  *
  ******************************************************************************/
-float shtc3_calc_temp(uint64_t tempData){
-  uint32_t raw_t;
-  float realTemp;
-  raw_t = (tempData >> 32) & tempHelper;
-
-  realTemp = ((((raw_t*175) >> 16) - 45) * 1.8) + 32; // this is for F
-
-  return realTemp;
-
 
+void shtc3_app_get_temp_and_hum(const SAMPLE_RECORD *record, int32_t *T, int32_t *H){
+  *H = conv_shtc3_rh(record->rawRh);
+  *T = conv_shtc3_temp(record->rawTemp);
 }
 
 /***************************************************************************/
 /**
  * @brief
- *  Helper function to calculate the humidity from he raw data we got from the sensor
+ *  Reports a good sample to the precision policy
  *
-
- * @note This function returns the humidity as a percentage.
+ * @details
+ *  Call once per SAMPLE_OK record taken from the sample queue. The sample picks the precision of the next
+ *  measurement and is the one the next sample is compared against.
  *
-
+ * @param[in] temp
+ *  Temperature of the sample in centi-degrees Celsius
  *
+ * @param[in] rh
+ *  Humidity of the sample in centi-percent RH
  *
  ******************************************************************************/
-float shtc3_calc_hum(uint64_t humData){
-  uint32_t raw_h;
-  float realHum;
-  raw_h = (humData >> 8) & tempHelper;
-  realHum = ((raw_h * 100) >> 16);
-
-
-  return realHum;
+void shtc3_sample_done(int32_t temp, int32_t rh){
+  shtc3_select_precision(temp, rh);
 }
 
 /***************************************************************************/
 /**
  * @brief
- *  Helper function that returns the humidity that can be used by the application layer
- *
-
- * @note This function returns the humidity as a percentage
+ *  Sets the humidity the application alerts on
  *
-
+ * @details
+ *  Samples within CONV_ALERT_BAND_CENTI of it are always measured in normal mode. SHTC3_NO_ALERT disables the
+ *  check.
  *
+ * @param[in] rh_centi
+ *  Alert threshold in centi-percent RH
  *
  ******************************************************************************/
-
-float get_SH_rh(void) {
-  return shtc3_calc_hum(SH_data);
+void shtc3_set_rh_alert(int32_t rh_centi){
+  shtc3_rh_alert = rh_centi;
 }
 
 /***************************************************************************/
 /**
  * @brief
- *  Helper function to return the temp, so the application layer can access it
-
- * @note This function returns the temperature in farenheight.
+ *  Precision the next measurement will be taken in
  *
+ ******************************************************************************/
+SHTC3_PRECISION shtc3_get_precision(void){
+  return shtc3_precision;
+}
 
+/***************************************************************************/
+/**
+ * @brief
+ *  Decides from the sample period if the sensor is kept awake between samples
  *
+ * @details
+ *  Putting the sensor to sleep costs the wakeup and sleep transactions, the MCU awake for them and the pull ups
+ *  sinking current while they are on the bus, and the wakeup time at idle current every sample. Keeping it awake
+ *  costs the idle minus sleep current for the whole period. The cheaper one is used, with the charges in fC from the
+ *  SHTC3_*_NA and _US constants. The sensor is woken or put to sleep on a change.
+ *
+ * @note
+ *  With the datasheet currents the break even period is about 9 ms, so the 3 s LETIMER period never keeps the
+ *  sensor awake. SHTC3_FORCE_KEEP_AWAKE runs that path for bring up.
+ *
+ * @param[in] period_ms
+ *  Time between samples in ms
  *
  ******************************************************************************/
-
-float get_SH_temp(void) {
-  return shtc3_calc_temp(SH_data);
+void shtc3_set_sample_period(uint32_t period_ms){
+  uint64_t sleep_cost;
+  uint64_t awake_cost;
+  bool keep_awake;
+
+  sleep_cost = (uint64_t)SHTC3_MCU_ACTIVE_NA * SHTC3_SLEEP_PAIR_US
+      + (uint64_t)SHTC3_PULLUP_NA * SHTC3_SLEEP_PAIR_BUS_US
+      + (uint64_t)SHTC3_IDLE_NA * SHTC3_WAKEUP_MS * 1000;
+  awake_cost = (uint64_t)(SHTC3_IDLE_NA - SHTC3_SLEEP_NA) * period_ms * 1000;
+  keep_awake = SHTC3_FORCE_KEEP_AWAKE || awake_cost < sleep_cost;
+
+  if(keep_awake != shtc3_keep_awake){
+      SH_write_helper(keep_awake ? SHTC3_wakeup_cmd : SHTC3_sleep_cmd, twoByte, 0);
+  }
+  shtc3_keep_awake = keep_awake;
 }
 
 /***************************************************************************/
 /**
  * @brief
- *  Helper function that returns the temperature and humidity so that the application layer can see them.
- *
-
- * @note This function returns the temperature in farenheight and humidity as a percentage.
+ *  true while the sensor is kept awake between samples
  *
+ ******************************************************************************/
+bool shtc3_get_keep_awake(void){
+  return shtc3_keep_awake;
+}
 
+/***************************************************************************/
+/**
+ * @brief
+ *  Resynchronizes the sensor power state after a failed transaction
  *
+ * @details
+ *  A chain abandoned part way can leave the sensor asleep while it is meant to be kept awake, so it is woken again.
+ *  A sleeping sensor is woken by every measurement chain and needs nothing.
  *
  ******************************************************************************/
-
-void shtc3_app_get_temp_and_hum(float T, float H){
-  H = shtc3_calc_hum(SH_data);
-  T = shtc3_calc_temp(SH_data);
+void shtc3_bus_error(void){
+  if(shtc3_keep_awake){
+      SH_write_helper(SHTC3_wakeup_cmd, twoByte, 0);
+  }
 }
@@ -9,9 +9,132 @@
 #include "Si7021.h"
 
 
-uint32_t read_result = 0;
+// read by the bus, a pair is handed to the main loop as a SAMPLE_RECORD by si7021_chain_done()
+static uint32_t read_result = 0;
 uint32_t writeValue = writeData;
-uint32_t temp_result = 0;
+static uint32_t temp_result = 0;
+
+static uint32_t user_reg_result = 0; // user register 1 read back by si7021_read_resolution()
+static volatile uint32_t si7021_resolution = SI7021_RESOLUTION; // resolution the measurement chains are picked for
+static uint32_t si7021_user_reg = SI7021_USER_REG_DEFAULT; // last value written to user register 1
+static volatile bool si7021_pipe_primed = false; // a pipelined conversion was started and not read yet
+
+// start a no hold measurement, sleep through the conversion, then read the result without a command
+#define SI7021_MEASURE_CHAIN(command, conv_ms, result) { \
+    { I2C_STEP_WRITE, (command), 1, 0, 0, 0, 0, false }, \
+    { I2C_STEP_DELAY, 0, 0, 0, 0, (conv_ms), 0, false }, \
+    { I2C_STEP_READ, 0, 0, (result), 2, 0, 0, false }, \
+}
+
+// the RH measurement, then the temperature it converted on the way, read with 0xE0 in the same chain so no other
+// measurement can get between the two
+#define SI7021_PAIR_CHAIN(conv_ms) { \
+    { I2C_STEP_WRITE, SI7021_CMD_MEASURE_RH_NO_HOLD, 1, 0, 0, 0, 0, false }, \
+    { I2C_STEP_DELAY, 0, 0, 0, 0, (conv_ms), 0, false }, \
+    { I2C_STEP_READ, 0, 0, &read_result, 2, 0, 0, false }, \
+    { I2C_STEP_READ, SI7021_CMD_MEASURE_TEMP, 1, &temp_result, 2, 0, 0, false }, \
+}
+
+// pipelined sampling: the conversion started last period has finished, read it and its temperature, then start the
+// next one and let it convert while the MCU sleeps until the next period, no delay step so any resolution works
+static const I2C_CHAIN_STEP si7021_pipe_chain[SI7021_PIPE_CHAIN_STEPS] = {
+    { I2C_STEP_READ, 0, 0, &read_result, 2, 0, 0, false },
+    { I2C_STEP_READ, SI7021_CMD_MEASURE_TEMP, 1, &temp_result, 2, 0, 0, false },
+    { I2C_STEP_WRITE, SI7021_CMD_MEASURE_RH_NO_HOLD, 1, 0, 0, 0, 0, false },
+};
+
+// resolution change: write user register 1, then read it back so a write the sensor did not take is caught
+// the write command carries the register value and is filled in by si7021_set_resolution()
+static I2C_CHAIN_STEP si7021_res_chain[SI7021_RES_CHAIN_STEPS] = {
+    { I2C_STEP_WRITE, 0, 2, 0, 0, 0, 0, false },
+    { I2C_STEP_READ, SI7021_CMD_READ_USER_REG, 1, &user_reg_result, 1, 0, 0, false },
+};
+
+// one chain per resolution with the datasheet maximum conversion time in ms, rounded up
+// an RH measurement also converts the temperature, so its time is the sum of both
+// the chain is picked when a measurement is queued, so one queued behind a resolution change uses the new time
+static const I2C_CHAIN_STEP si7021_rh_chain[SI7021_NUM_RESOLUTIONS][SI7021_MEASURE_CHAIN_STEPS] = {
+    [SI7021_RES_RH12_T14] = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_RH_NO_HOLD, 23, &read_result),
+    [SI7021_RES_RH8_T12]  = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_RH_NO_HOLD, 7, &read_result),
+    [SI7021_RES_RH10_T13] = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_RH_NO_HOLD, 11, &read_result),
+    [SI7021_RES_RH11_T11] = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_RH_NO_HOLD, 10, &read_result),
+};
+static const I2C_CHAIN_STEP si7021_temp_chain[SI7021_NUM_RESOLUTIONS][SI7021_MEASURE_CHAIN_STEPS] = {
+    [SI7021_RES_RH12_T14] = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_TEMP_NO_HOLD, 11, &temp_result),
+    [SI7021_RES_RH8_T12]  = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_TEMP_NO_HOLD, 4, &temp_result),
+    [SI7021_RES_RH10_T13] = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_TEMP_NO_HOLD, 7, &temp_result),
+    [SI7021_RES_RH11_T11] = SI7021_MEASURE_CHAIN(SI7021_CMD_MEASURE_TEMP_NO_HOLD, 3, &temp_result),
+};
+static const I2C_CHAIN_STEP si7021_pair_chain[SI7021_NUM_RESOLUTIONS][SI7021_PAIR_CHAIN_STEPS] = {
+    [SI7021_RES_RH12_T14] = SI7021_PAIR_CHAIN(23),
+    [SI7021_RES_RH8_T12]  = SI7021_PAIR_CHAIN(7),
+    [SI7021_RES_RH10_T13] = SI7021_PAIR_CHAIN(11),
+    [SI7021_RES_RH11_T11] = SI7021_PAIR_CHAIN(10),
+};
+
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Hook of the pair and pipeline chains
+ *
+ * @details
+ *  Runs in the I2C interrupt that ends the chain, so the pair is copied into a record before the next transaction
+ *  on the bus can overwrite read_result and temp_result. An abandoned chain posts a SAMPLE_BUS_ERROR record.
+ *
+ * @param[in] ok
+ *  false if the chain was abandoned on a failure
+ *
+ ******************************************************************************/
+static void si7021_chain_done(bool ok){
+  SAMPLE_RECORD record;
+
+  record.timestamp = rtcc_get_count();
+  record.rawRh = (uint16_t)read_result;
+  record.rawTemp = (uint16_t)temp_result;
+  record.sensor = SENSOR_SI7021;
+  record.status = ok ? SAMPLE_OK : SAMPLE_BUS_ERROR;
+  sample_queue_post(&record);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Hook of the write that primes the pipeline
+ *
+ * @details
+ *  A failed write started no conversion, so the next sample primes again instead of reading one that does not
+ *  exist.
+ *
+ * @param[in] ok
+ *  false if the write failed
+ *
+ ******************************************************************************/
+static void si7021_prime_done(bool ok){
+  if(!ok){
+      si7021_pipe_primed = false;
+  }
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Hook of the resolution write and read back
+ *
+ * @details
+ *  If the RES bits read back differ from the ones written, or the chain failed, the resolution of the sensor is
+ *  not known. The measurement chains then fall back to the 12/14 bit conversion times, the longest of all, so no
+ *  read comes before the conversion ends whatever the sensor runs at.
+ *
+ * @param[in] ok
+ *  false if the chain was abandoned on a failure
+ *
+ ******************************************************************************/
+static void si7021_res_done(bool ok){
+  if(!ok || (user_reg_result & SI7021_USER_REG_RES_MASK) != (si7021_user_reg & SI7021_USER_REG_RES_MASK)){
+      si7021_resolution = SI7021_RES_RH12_T14;
+  }
+}
 
 
 /***************************************************************************/
@@ -24,16 +147,17 @@ uint32_t temp_result = 0;
  *
  * @note
  * It then calls the i2c_open function at the end and passes in the I2C_OPEN_STRUCT_TypeDef that we defined within the function.
+ * The sensor supply is switched by sensor_power.c, nothing is sent to the sensor until si7021_power_on() is called.
  *
- * @param[in] void
+ * @param[in] error_cb
+ * Event scheduled when a transaction with the sensor fails
  *
  *
  ******************************************************************************/
 
-void si7021_i2c_open(){
+void si7021_i2c_open(uint32_t error_cb){
 
 
-  timer_delay(SI7021_POWERON_DELAY);
   I2C_OPEN_STRUCT_TypeDef I2C_si;
 
   I2C_si.freq = I2C_freq;
@@ -42,12 +166,18 @@ void si7021_i2c_open(){
   I2C_si.ROUTEscl = I2C_ROUTE_SCL;
   I2C_si.scl_pin_en = true;
   I2C_si.sda_pin_en = true;
+  I2C_si.ldma_en = SI7021_LDMA_EN;
+  I2C_si.error_cb = error_cb;
+  I2C_si.scl_port = SI7021_SCL_PORT;
+  I2C_si.scl_pin = SI7021_SCL_PIN;
+  I2C_si.sda_port = SI7021_SDA_PORT;
+  I2C_si.sda_pin = SI7021_SDA_PIN;
   I2C_si.enable =  true;
   I2C_si.master = true;
   I2C_si.refFreq = 0;
 
-
   i2c_open(SI7021_I2C, &I2C_si);
+  i2c_set_device_speed(SI7021_I2C, SI7021_Address, SI7021_SPEED);
 
 
 }
@@ -63,6 +193,8 @@ void si7021_i2c_open(){
  *
  * @note
  *This function allows the application driver to access the private variables with the Si7021.c file.
+ *The no hold measurements run as a chain that waits out the conversion time in EM2 instead of polling the sensor
+ *with its address until it stops NACKing, so bytes is ignored for them.
  *
  * @param[in] uint8_t command, uint8_t bytes, uint32_t callback
  *
@@ -72,11 +204,22 @@ void si7021_i2c_open(){
 
 void SI7021_Read_Helper(uint8_t command, uint8_t bytes, uint32_t callback){
   STATE_MACHINE_START_STRUCT startStruct;
+
+  if(command == SI7021_CMD_MEASURE_RH_NO_HOLD){
+      i2c_start_chain(SI7021_I2C, SI7021_Address, si7021_rh_chain[si7021_resolution], SI7021_MEASURE_CHAIN_STEPS, callback, 0);
+      return;
+  }
+  if(command == SI7021_CMD_MEASURE_TEMP_NO_HOLD){
+      i2c_start_chain(SI7021_I2C, SI7021_Address, si7021_temp_chain[si7021_resolution], SI7021_MEASURE_CHAIN_STEPS, callback, 0);
+      return;
+  }
   startStruct.newDeviceAddress = SI7021_Address;
-  read_result = 0;
   if(command == 0xF5){
       startStruct.newBufferAddress = &read_result;
   }
+  else if(command == SI7021_CMD_READ_USER_REG){
+      startStruct.newBufferAddress = &user_reg_result;
+  }
   else{
       startStruct.newBufferAddress = &temp_result;
   }
@@ -85,6 +228,12 @@ void SI7021_Read_Helper(uint8_t command, uint8_t bytes, uint32_t callback){
   startStruct.newBytesleft = bytes;
   startStruct.newCallBack = callback;
   startStruct.newNumCmdBytes = 1;
+  startStruct.newCombinedBytes = 1 + bytes;
+  startStruct.newData = 0;
+  startStruct.newRepeatedStart = 0;
+  startStruct.newChain = 0;
+  startStruct.newByteBuffer = 0;
+  startStruct.newStopBeforeRead = false;
 
 
   i2c_start(SI7021_I2C, &startStruct);
@@ -95,49 +244,117 @@ void SI7021_Read_Helper(uint8_t command, uint8_t bytes, uint32_t callback){
 void SI7021_Write_Helper(uint8_t bytes, uint8_t command){
   STATE_MACHINE_START_STRUCT startStruct;
   startStruct.newDeviceAddress = SI7021_Address;
-  read_result = 0;
   startStruct.newBufferAddress = &writeValue;
   startStruct.newRead = false;
   startStruct.newCommand = command;
   startStruct.newBytesleft = bytes;
   startStruct.newNumCmdBytes = 1;
+  startStruct.newCombinedBytes = 1 + bytes;
+  startStruct.newCallBack = 0;
+  startStruct.newData = 0;
+  startStruct.newRepeatedStart = 0;
+  startStruct.newChain = 0;
+  startStruct.newByteBuffer = 0;
+  startStruct.newStopBeforeRead = false;
 
   i2c_start(SI7021_I2C, &startStruct);
 }
 
+/***************************************************************************/
+/**
+ * @brief
+ *  Sets the measurement resolution of the Si7021
+ *
+ * @details
+ *  Writes the RES1 and RES0 bits of user register 1 with a two byte write of the register command and value. The
+ *  other bits are written from the last value sent, starting at the reset value, since this driver never turns the
+ *  heater on. Measurements queued after this call use the conversion time of the new resolution.
+ *
+ *  The register is read back in the same chain. On a mismatch, a failed chain or a full bus queue the measurement
+ *  chains use the 12/14 bit conversion times, see si7021_res_done().
+ *
+ * @note
+ *  The write step is shared, so a second call must wait for the callback of the first.
+ *
+ * @param[in] resolution
+ *  One of the SI7021_RES_ codes
+ *
+ * @param[in] callback
+ *  Event scheduled once the register is written and read back, 0 for none
+ *
+ ******************************************************************************/
+void si7021_set_resolution(uint32_t resolution, uint32_t callback){
+  EFM_ASSERT(resolution < SI7021_NUM_RESOLUTIONS);
 
+  si7021_user_reg &= ~(SI7021_USER_REG_RES1 | SI7021_USER_REG_RES0);
+  if(resolution & 0x2){
+      si7021_user_reg |= SI7021_USER_REG_RES1;
+  }
+  if(resolution & 0x1){
+      si7021_user_reg |= SI7021_USER_REG_RES0;
+  }
+  si7021_resolution = resolution;
 
-uint32_t decode_temp(uint8_t temp) // for temp & ment to use my array instead, not for this lab disregard
-{
-  float actual_temp;
-  uint32_t rounded_temp;
+  si7021_res_chain[0].command = (SI7021_CMD_WRITE_USER_REG << 8) | si7021_user_reg;
+  user_reg_result = 0;
+  if(!i2c_start_chain(SI7021_I2C, SI7021_Address, si7021_res_chain, SI7021_RES_CHAIN_STEPS, callback,
+                      si7021_res_done)){
+      si7021_resolution = SI7021_RES_RH12_T14;
+  }
+}
 
-  // Formula to decode read Temperature from the Si7021 Datasheet
-  actual_temp = (((temp) * 175.72) / 65536) - 46.85;
+/***************************************************************************/
+/**
+ * @brief
+ *  Reads user register 1 back from the Si7021
+ *
+ * @details
+ *  Once the callback event is scheduled si7021_get_resolution() decodes the resolution the sensor reported.
+ *
+ * @param[in] callback
+ *  Event scheduled once the register is read
+ *
+ ******************************************************************************/
+void si7021_read_resolution(uint32_t callback){
+  SI7021_Read_Helper(SI7021_CMD_READ_USER_REG, 1, callback);
+}
 
-  // Round the temperature to an integer value
-  rounded_temp = (uint32_t)(actual_temp + 0.5 - (actual_temp < 0));
+/***************************************************************************/
+/**
+ * @brief
+ *  Resolution code in the last user register read back with si7021_read_resolution()
+ *
+ ******************************************************************************/
+uint32_t si7021_get_resolution(void){
+  uint32_t resolution = 0;
 
-  return rounded_temp;
+  if(user_reg_result & SI7021_USER_REG_RES1){
+      resolution |= 0x2;
+  }
+  if(user_reg_result & SI7021_USER_REG_RES0){
+      resolution |= 0x1;
+  }
+  return resolution;
 }
 
-uint32_t get_Si7021_temp(void){
-  return decode_temp(temp_result);
-}
 
 
-/***************************************************************************//**
- * Function to decode Relative Humidity from the read value
+/***************************************************************************/
+/**
+ * @brief
+ *  get_Si7021_temp
+ * @details
+ *  This function returns the temperature that the sensor recorded, in centi-degrees Celsius.
+ * @note
+ * The private temp_result word is decoded with the integer datasheet formula in conversion.c.
+ *
+ * @param[in] void
+ *
  *
- * This function decodes RH data using the formula provided in the Si7021
- * datasheet. Returns the value in Percent.
  ******************************************************************************/
 
-float decode_rh(float humidity){
-
-  humidity = (((humidity) * 125) / 65536) - 6;
-
-  return humidity;
+int32_t get_Si7021_temp(void){
+  return conv_si7021_temp(temp_result);
 }
 
 
@@ -146,16 +363,131 @@ float decode_rh(float humidity){
  * @brief
  *  get_si7021_rh
  * @details
- *  This function returns the relative humidity that the sensor recorded.
+ *  This function returns the relative humidity that the sensor recorded, in centi-percent RH.
  * @note
- * The function calls the decode rh function and passes in the private read_result variable that has the recorded data from the sensor. The
- * get_si7021_rh function then returns the decoded value.
+ * The private read_result word is decoded with the integer datasheet formula in conversion.c.
  *
  * @param[in] void
  *
  *
  ******************************************************************************/
 
-float get_si7021_rh(void) {
-  return decode_rh(read_result); // need to share the private variable
+int32_t get_si7021_rh(void) {
+  return conv_si7021_rh(read_result); // need to share the private variable
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Measures the relative humidity and the temperature of the same conversion
+ *
+ * @details
+ *  Runs the RH measurement chain with the 0xE0 read of its temperature as the last step, so the pair costs one
+ *  command and one read address less than a separate temperature measurement, needs no second conversion, and
+ *  schedules one event. The pair is posted to the SENSOR_SI7021 sample queue from the interrupt that reads it.
+ *
+ * @param[in] callback
+ *  Event scheduled once both values are read
+ *
+ * @return
+ *  false if the bus queue was full and the chain was not submitted, no record is posted then
+ *
+ ******************************************************************************/
+bool si7021_read_rh_and_temp(uint32_t callback){
+  return i2c_start_chain(SI7021_I2C, SI7021_Address, si7021_pair_chain[si7021_resolution], SI7021_PAIR_CHAIN_STEPS, callback,
+                  si7021_chain_done);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Converts a pair taken from the SENSOR_SI7021 sample queue
+ *
+ * @param[in] record
+ *  A SAMPLE_OK record posted by si7021_read_rh_and_temp() or si7021_pipeline_sample()
+ *
+ * @param[out] rh
+ *  Relative humidity in centi-percent RH
+ *
+ * @param[out] temp
+ *  Temperature in centi-degrees Celsius
+ *
+ ******************************************************************************/
+void si7021_get_rh_and_temp(const SAMPLE_RECORD *record, int32_t *rh, int32_t *temp){
+  EFM_ASSERT(record->sensor == SENSOR_SI7021);
+  *rh = conv_si7021_rh(record->rawRh);
+  *temp = conv_si7021_temp(record->rawTemp);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Takes one pipelined sample
+ *
+ * @details
+ *  Call once per sampling period instead of si7021_read_rh_and_temp(). The bus is only busy for the read of the
+ *  conversion started by the previous call and the command of the next one, so the MCU is not kept out of EM2 for
+ *  the conversion time. The pair read is one period old. The first call only starts a conversion.
+ *
+ * @note
+ *  The period has to be longer than the conversion time of the resolution, otherwise the read is NACKed until the
+ *  conversion ends.
+ *
+ * @param[in] callback
+ *  Event scheduled once the pair is read and posted to the SENSOR_SI7021 sample queue
+ *
+ * @return
+ *  SI7021_PIPE_READING if a pair is being read, SI7021_PIPE_PRIMING if this call only started the first conversion,
+ *  SI7021_PIPE_REFUSED if the bus queue was full, no record is posted then
+ *
+ ******************************************************************************/
+SI7021_PIPE_STATUS si7021_pipeline_sample(uint32_t callback){
+  if(!si7021_pipe_primed){
+      // set before the write is submitted, its hook may clear it again from the I2C interrupt
+      si7021_pipe_primed = true;
+      if(!i2c_start_chain(SI7021_I2C, SI7021_Address, &si7021_pipe_chain[SI7021_PIPE_CHAIN_STEPS - 1], 1, 0,
+                          si7021_prime_done)){
+          si7021_pipe_primed = false;
+      }
+      return SI7021_PIPE_PRIMING;
+  }
+  if(!i2c_start_chain(SI7021_I2C, SI7021_Address, si7021_pipe_chain, SI7021_PIPE_CHAIN_STEPS, callback,
+                      si7021_chain_done)){
+      return SI7021_PIPE_REFUSED;
+  }
+  return SI7021_PIPE_READING;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Restarts the pipeline with a fresh conversion on the next sample
+ *
+ * @details
+ *  Called after a failed transaction, when it is not known if a conversion is pending in the sensor.
+ *
+ ******************************************************************************/
+void si7021_pipeline_reset(void){
+  si7021_pipe_primed = false;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Sets the sensor up after its supply came on
+ *
+ * @details
+ *  The I2C is reset first, so a start seen while the bus pins were off does not leave it busy. A power up resets
+ *  user register 1 and drops any pipelined conversion, so the resolution in use is written again and the pipeline
+ *  starts over.
+ *
+ * @note
+ *  Called from the main loop with nothing on the Si7021 bus or queued for it.
+ *
+ ******************************************************************************/
+void si7021_power_on(void){
+  i2c_bus_reset(SI7021_I2C);
+  si7021_user_reg = SI7021_USER_REG_DEFAULT;
+  si7021_pipe_primed = false;
+  si7021_set_resolution(si7021_resolution, 0);
 }
@@ -20,6 +20,32 @@
 //***********************************************************************************
 // Static / Private Variables
 //***********************************************************************************
+static uint32_t si7021_errors;
+static uint32_t shtc3_errors;
+
+// one thread per sensor, run from its own event
+static TASK si7021_task;
+static TASK shtc3_task;
+static volatile bool sample_requested[SENSOR_NUM_IDS]; // a sample is wanted, taken by the thread of the sensor
+static uint32_t shtc3_crc_retries; // retries taken by the SHTC3 measurement in progress
+
+typedef struct{
+  uint32_t event_id;
+  SCHEDULER_HANDLER handler;
+  uint32_t profile_id;
+}APP_EVENT;
+
+// registered in this order, which is the dispatch priority
+static const APP_EVENT app_events[] = {
+    { LETIMER0_UF_EVT, scheduled_letimer0_UF_cb, PROFILE_LETIMER0_UF_CB },
+    { LETIMER0_COMP1_EVT, scheduled_letimer0_COMP1_cb, PROFILE_LETIMER0_COMP1_CB },
+    { LETIMER0_COMP0_EVT, scheduled_letimer0_COMP0_cb, PROFILE_LETIMER0_COMP0_CB },
+    { GPIO_ODD_IRQ_EVT, scheduled_gpio_odd_irq_cb, PROFILE_GPIO_ODD_IRQ_CB },
+    { GPIO_EVEN_IRQ_EVT, scheduled_gpio_even_irq_cb, PROFILE_GPIO_EVEN_IRQ_CB },
+    { SI7021_TASK_EVT, scheduled_si7021_task_cb, PROFILE_SI7021_TASK },
+    { SH_TASK_EVT, scheduled_SHTC3_task_cb, PROFILE_SH_TASK },
+};
+#define APP_NUM_EVENTS  (sizeof(app_events) / sizeof(app_events[0]))
 
 
 //***********************************************************************************
@@ -28,6 +54,161 @@
 
 static void app_letimer_pwm_open(float period, float act_period, uint32_t out0_route, uint32_t out1_route);
 
+/***************************************************************************/
+/**
+ * @brief
+ *  Asks the thread of a sensor for a sample
+ *
+ * @details
+ *  A request made while the thread is busy with the last one is taken once that one is done.
+ *
+ ******************************************************************************/
+static void app_start_sensor(SENSOR_ID sensor){
+  sample_requested[sensor] = true;
+  task_signal(sensor == SENSOR_SI7021 ? &si7021_task : &shtc3_task);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Hands a sample to the acquisition policy
+ *
+ * @details
+ *  The primary drives LED1 and may ask for a cross check with the other sensor right away. A secondary sample
+ *  only feeds the disagreement statistics.
+ *
+ ******************************************************************************/
+static void app_sensor_sample(SENSOR_ID sensor, const SENSOR_SAMPLE *sample){
+  if(sensor != sensor_policy_primary()){
+      sensor_policy_secondary_sample(sample);
+      return;
+  }
+  if (sample->rhCenti >= SI7021_HUMIDITY_LED_THRESHOLD){
+      GPIO_PinOutSet(LED1_PORT, LED1_PIN);
+  } else {
+      GPIO_PinOutClear(LED1_PORT, LED1_PIN);
+  }
+  if(sensor_policy_primary_sample(sample)){
+      app_start_sensor(sensor == SENSOR_SI7021 ? SENSOR_SHTC3 : SENSOR_SI7021);
+  }
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Si7021 sampling thread
+ *
+ * @details
+ *  Writes the sensor settings once its supply first comes up, then for every request: powers the sensor up when
+ *  its supply is gated and off, measures the RH and temperature pair, waits for the record the I2C interrupt posts, switches
+ *  a gated supply off again and hands the pair on. The pipeline hands back last period's conversion, so it is only
+ *  used while the Si7021 is the primary, read every period, and not gated.
+ *
+ *  The bus error callback is the event of the thread as well, so a failed chain resumes it with its
+ *  SAMPLE_BUS_ERROR record. No new humidity reading exists then, so the LED is turned off rather than left
+ *  showing a stale one when the Si7021 drives it, and the pipeline starts over with a new conversion. A chain the
+ *  full bus queue refused takes the same path, as no record would ever be posted for it.
+ *
+ ******************************************************************************/
+static TASK_STATUS app_si7021_thread(TASK *task){
+  SAMPLE_RECORD record;
+  SENSOR_SAMPLE sample;
+  SI7021_PIPE_STATUS pipe;
+  bool submitted;
+
+  TASK_BEGIN(task);
+  TASK_WAIT_UNTIL(task, sensor_power_state() == SENSOR_POWER_ON);
+  si7021_power_on();
+
+  while(true){
+      TASK_WAIT_UNTIL(task, sample_requested[SENSOR_SI7021]);
+      sample_requested[SENSOR_SI7021] = false;
+
+      if(sensor_power_gated() && sensor_power_state() != SENSOR_POWER_ON){
+          sensor_power_request(task_event(task));
+          TASK_WAIT_UNTIL(task, sensor_power_state() == SENSOR_POWER_ON);
+          si7021_power_on();
+      }
+      if(SI7021_PIPELINED && !sensor_power_gated() && sensor_policy_primary() == SENSOR_SI7021){
+          pipe = si7021_pipeline_sample(task_event(task));
+          if(pipe == SI7021_PIPE_PRIMING){
+              continue;  // only started the first conversion
+          }
+          submitted = (pipe == SI7021_PIPE_READING);
+      }
+      else{
+          submitted = si7021_read_rh_and_temp(task_event(task));
+      }
+      if(submitted){
+          TASK_WAIT_UNTIL(task, sample_queue_get(SENSOR_SI7021, &record));
+      }
+      else{
+          record.status = SAMPLE_BUS_ERROR;  // nothing will be posted, fail the sample rather than wait for good
+      }
+      sensor_power_release();
+
+      if(record.status == SAMPLE_OK){
+          si7021_get_rh_and_temp(&record, &sample.rhCenti, &sample.tempCenti);
+          app_sensor_sample(SENSOR_SI7021, &sample);
+      }
+      else{
+          si7021_errors++;
+          si7021_pipeline_reset();
+          if(sensor_policy_primary() == SENSOR_SI7021){
+              GPIO_PinOutClear(LED1_PORT, LED1_PIN);
+          }
+      }
+  }
+  TASK_END(task);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  SHTC3 sampling thread
+ *
+ * @details
+ *  For every request: runs the measurement chain, which wakes the sensor, measures, reads and puts it back to sleep
+ *  from the I2C interrupts, then waits for the record the chain posts. A frame that failed its CRC is measured
+ *  again up to SHTC3_CRC_RETRIES times before the sample is dropped.
+ *
+ *  The bus error callback is the event of the thread as well. A failed chain is counted and a sensor kept awake
+ *  between samples is woken again in case the chain left it asleep, the next request starts a new chain. A chain the
+ *  full bus queue refused is handled as a failed one.
+ *
+ ******************************************************************************/
+static TASK_STATUS app_shtc3_thread(TASK *task){
+  SAMPLE_RECORD record;
+  SENSOR_SAMPLE sample;
+
+  TASK_BEGIN(task);
+  while(true){
+      TASK_WAIT_UNTIL(task, sample_requested[SENSOR_SHTC3]);
+      sample_requested[SENSOR_SHTC3] = false;
+
+      shtc3_crc_retries = 0;
+      do{
+          if(shtc3_read_data_and_crc(task_event(task))){
+              TASK_WAIT_UNTIL(task, sample_queue_get(SENSOR_SHTC3, &record));
+          }
+          else{
+              record.status = SAMPLE_BUS_ERROR;  // nothing will be posted, fail the sample rather than wait for good
+          }
+      }while(record.status == SAMPLE_CRC_ERROR && shtc3_crc_retries++ < SHTC3_CRC_RETRIES);
+
+      if(record.status == SAMPLE_OK){
+          shtc3_app_get_temp_and_hum(&record, &sample.tempCenti, &sample.rhCenti);
+          shtc3_sample_done(sample.tempCenti, sample.rhCenti);
+          app_sensor_sample(SENSOR_SHTC3, &sample);
+      }
+      else if(record.status == SAMPLE_BUS_ERROR){
+          shtc3_errors++;
+          shtc3_bus_error();
+      }
+  }
+  TASK_END(task);
+}
+
 //***********************************************************************************
 // Global functions
 //***********************************************************************************
@@ -45,13 +226,29 @@ static void app_letimer_pwm_open(float period, float act_period, uint32_t out0_r
  ******************************************************************************/
 
 void app_peripheral_setup(void){
+  uint32_t i;
+
+#ifdef PROFILE_ENABLE
+  profiler_open();
+#endif
   cmu_open();
   sleep_open();
   gpio_open();
   scheduler_open();
+  for(i = 0; i < APP_NUM_EVENTS; i++){
+      scheduler_register(app_events[i].event_id, i, app_events[i].handler, app_events[i].profile_id);
+  }
+  task_open(&si7021_task, SI7021_TASK_EVT);
+  task_open(&shtc3_task, SH_TASK_EVT);
   gpio_open();
-  si7021_i2c_open();
-  SH_I2C_open();
+  rtcc_open();
+  sample_queue_open();
+  sensor_power_open((uint32_t)(PWM_PER * 1000), task_event(&si7021_task));
+  si7021_i2c_open(task_event(&si7021_task));
+  SH_I2C_open(task_event(&shtc3_task));
+  shtc3_set_rh_alert(SI7021_HUMIDITY_LED_THRESHOLD);
+  shtc3_set_sample_period((uint32_t)(PWM_PER * 1000));
+  sensor_policy_open(SENSOR_PRIMARY, SENSOR_POLICY_VERIFY_EVERY, SI7021_HUMIDITY_LED_THRESHOLD);
   app_letimer_pwm_open(PWM_PER, PWM_ACT_PER, PWM_ROUTE_0, PWM_ROUTE_1);
   letimer_start(LETIMER0, true);   // letimer_start will inform the LETIMER0 peripheral to begin counting.
 }
@@ -110,9 +307,10 @@ void app_letimer_pwm_open(float period, float act_period, uint32_t out0_route, u
 
 void scheduled_letimer0_UF_cb(void){
   EFM_ASSERT(!(get_scheduled_events() & LETIMER0_UF_CB));
-  SI7021_Read_Helper(SI7021_CMD_MEASURE_RH_NO_HOLD, 2, SI7021_READ_CB);
-  SI7021_Read_Helper(SI7021_CMD_MEASURE_TEMP, 2, SI7021_READ_TEMP_CB);
-  shtc3_read_data_and_crc(SH_CB);
+  app_start_sensor(sensor_policy_primary());
+  if(sensor_policy_period()){
+      app_start_sensor(sensor_policy_primary() == SENSOR_SI7021 ? SENSOR_SHTC3 : SENSOR_SI7021);
+  }
 
 
 
@@ -211,35 +409,33 @@ void scheduled_gpio_even_irq_cb(void){
 /***************************************************************************/
 /**
  * @brief
- *  scheduled_si7021_read_cb function
+ *  scheduled_si7021_task_cb function
  * @details
- * This function gets the relative humidity reading and then either turns on the led or keeps the led off depending the what the relative humidity reading is.
+ * Resumes the Si7021 sampling thread. Its event is posted by sample requests, the end of the measurement chain,
+ * a failed transaction on the Si7021 bus and the sensor supply coming up.
  *
  * @param[in] void
  *
  *
  ******************************************************************************/
 
-
-void scheduled_si7021_read_cb(void) {
-  float humidity = get_si7021_rh();
-  if (humidity >= SI7021_HUMIDITY_LED_THRESHOLD){
-      GPIO_PinOutSet(LED1_PORT, LED1_PIN);
-  } else {
-      GPIO_PinOutClear(LED1_PORT, LED1_PIN);
-  }
+void scheduled_si7021_task_cb(void) {
+  app_si7021_thread(&si7021_task);
 }
 
-void scheduled_si7021_read_temp_cb(void){
-  uint32_t temp = get_Si7021_temp();
-//  EFM_ASSERT(temp > 0); tried to get rid of the warning but it didnt work so I just commented it out
-}
+/***************************************************************************/
+/**
+ * @brief
+ *  scheduled_SHTC3_task_cb function
+ * @details
+ * Resumes the SHTC3 sampling thread. Its event is posted by sample requests, the end of the measurement chain and
+ * a failed transaction on the SHTC3 bus.
+ *
+ * @param[in] void
+ *
+ *
+ ******************************************************************************/
 
-void scheduled_SHTC3_read_cb(void){
-  float H;
-  float T;
-  shtc3_app_get_temp_and_hum(&T, &H);
+void scheduled_SHTC3_task_cb(void){
+  app_shtc3_thread(&shtc3_task);
 }
-
-
-
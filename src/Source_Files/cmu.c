@@ -59,6 +59,9 @@ void cmu_open(void){
     // Route LF clock to LETIMER0 clock tree
     CMU_ClockSelectSet(cmuClock_LFA , cmuSelect_ULFRCO); // What clock tree does the LETIMER0 reside on?
 
+    // Route LF clock to the RTCC clock tree, used for the low energy delays in rtcc.c
+    CMU_ClockSelectSet(cmuClock_LFE , cmuSelect_ULFRCO);
+
     // Now, you must ensure that the global Low Frequency is enabled
     CMU_ClockEnable(cmuClock_CORELE , true); //This enumeration is found in the Lab 2 assignment
 
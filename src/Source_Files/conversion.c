@@ -0,0 +1,108 @@
+/**
+ * @file conversion.c
+ * @author Max Kilcoyne
+ * @brief Integer conversion of raw sensor words to centi-degrees and centi-percent RH
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "conversion.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Shared kernel of the datasheet formulas
+ *
+ * @details
+ *  k * raw stays below 2^31 for every 16 bit raw word and k up to 32767, so the product, rounding and shift are done
+ *  in 32 bit unsigned math with no overflow and no floating point.
+ *
+ * @param[in] raw
+ *   Raw sensor word, only the low 16 bits are used
+ *
+ * @param[in] k
+ *   Formula slope times 100
+ *
+ * @param[in] offset
+ *   Formula offset times 100
+ *
+ * @return
+ *   The formula value in hundredths, rounded to nearest
+ *
+ ******************************************************************************/
+static int32_t conv_scale(uint32_t raw, uint32_t k, int32_t offset){
+  return (int32_t)((k * (raw & 0xFFFF) + CONV_ROUND) >> 16) + offset;
+}
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Sensor word conversions
+ *
+ * @details
+ *  Each one applies the datasheet formula of its sensor and quantity through conv_scale(). The Si7021 status bits
+ *  in the two LSBs are converted along with the word, as the datasheet formula does.
+ *
+ * @param[in] raw
+ *   Raw 16 bit word read from the sensor
+ *
+ * @return
+ *   centi-degrees Celsius or centi-percent RH
+ *
+ ******************************************************************************/
+int32_t conv_si7021_rh(uint32_t raw){
+  return conv_scale(raw, CONV_SI7021_RH_K, CONV_SI7021_RH_OFF);
+}
+
+int32_t conv_si7021_temp(uint32_t raw){
+  return conv_scale(raw, CONV_SI7021_TEMP_K, CONV_SI7021_TEMP_OFF);
+}
+
+int32_t conv_shtc3_rh(uint32_t raw){
+  return conv_scale(raw, CONV_SHTC3_RH_K, CONV_SHTC3_RH_OFF);
+}
+
+int32_t conv_shtc3_temp(uint32_t raw){
+  return conv_scale(raw, CONV_SHTC3_TEMP_K, CONV_SHTC3_TEMP_OFF);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Difference of two readings without the sign
+ *
+ * @details
+ *  Taken in unsigned math, so it does not overflow for any two int32_t readings.
+ *
+ ******************************************************************************/
+uint32_t conv_abs_diff(int32_t a, int32_t b){
+  return (a > b) ? ((uint32_t)a - (uint32_t)b) : ((uint32_t)b - (uint32_t)a);
+}
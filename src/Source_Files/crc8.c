@@ -0,0 +1,192 @@
+/**
+ * @file crc8.c
+ * @author Max Kilcoyne
+ * @brief CRC-8 of the Sensirion sensor words with table, nibble table and GPCRC backends
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "crc8.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+#if CRC8_BACKEND == CRC8_BACKEND_TABLE
+// CRC of every byte value with a zero initial value
+static const uint8_t crc8_table[256] = {
+    0x00, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97, 0xB9, 0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E,
+    0x43, 0x72, 0x21, 0x10, 0x87, 0xB6, 0xE5, 0xD4, 0xFA, 0xCB, 0x98, 0xA9, 0x3E, 0x0F, 0x5C, 0x6D,
+    0x86, 0xB7, 0xE4, 0xD5, 0x42, 0x73, 0x20, 0x11, 0x3F, 0x0E, 0x5D, 0x6C, 0xFB, 0xCA, 0x99, 0xA8,
+    0xC5, 0xF4, 0xA7, 0x96, 0x01, 0x30, 0x63, 0x52, 0x7C, 0x4D, 0x1E, 0x2F, 0xB8, 0x89, 0xDA, 0xEB,
+    0x3D, 0x0C, 0x5F, 0x6E, 0xF9, 0xC8, 0x9B, 0xAA, 0x84, 0xB5, 0xE6, 0xD7, 0x40, 0x71, 0x22, 0x13,
+    0x7E, 0x4F, 0x1C, 0x2D, 0xBA, 0x8B, 0xD8, 0xE9, 0xC7, 0xF6, 0xA5, 0x94, 0x03, 0x32, 0x61, 0x50,
+    0xBB, 0x8A, 0xD9, 0xE8, 0x7F, 0x4E, 0x1D, 0x2C, 0x02, 0x33, 0x60, 0x51, 0xC6, 0xF7, 0xA4, 0x95,
+    0xF8, 0xC9, 0x9A, 0xAB, 0x3C, 0x0D, 0x5E, 0x6F, 0x41, 0x70, 0x23, 0x12, 0x85, 0xB4, 0xE7, 0xD6,
+    0x7A, 0x4B, 0x18, 0x29, 0xBE, 0x8F, 0xDC, 0xED, 0xC3, 0xF2, 0xA1, 0x90, 0x07, 0x36, 0x65, 0x54,
+    0x39, 0x08, 0x5B, 0x6A, 0xFD, 0xCC, 0x9F, 0xAE, 0x80, 0xB1, 0xE2, 0xD3, 0x44, 0x75, 0x26, 0x17,
+    0xFC, 0xCD, 0x9E, 0xAF, 0x38, 0x09, 0x5A, 0x6B, 0x45, 0x74, 0x27, 0x16, 0x81, 0xB0, 0xE3, 0xD2,
+    0xBF, 0x8E, 0xDD, 0xEC, 0x7B, 0x4A, 0x19, 0x28, 0x06, 0x37, 0x64, 0x55, 0xC2, 0xF3, 0xA0, 0x91,
+    0x47, 0x76, 0x25, 0x14, 0x83, 0xB2, 0xE1, 0xD0, 0xFE, 0xCF, 0x9C, 0xAD, 0x3A, 0x0B, 0x58, 0x69,
+    0x04, 0x35, 0x66, 0x57, 0xC0, 0xF1, 0xA2, 0x93, 0xBD, 0x8C, 0xDF, 0xEE, 0x79, 0x48, 0x1B, 0x2A,
+    0xC1, 0xF0, 0xA3, 0x92, 0x05, 0x34, 0x67, 0x56, 0x78, 0x49, 0x1A, 0x2B, 0xBC, 0x8D, 0xDE, 0xEF,
+    0x82, 0xB3, 0xE0, 0xD1, 0x46, 0x77, 0x24, 0x15, 0x3B, 0x0A, 0x59, 0x68, 0xFF, 0xCE, 0x9D, 0xAC,
+};
+#else
+// CRC of every nibble value shifted through the top of the register, the GPCRC backend falls back on it
+static const uint8_t crc8_nibble_table[16] = {
+    0x00, 0x31, 0x62, 0x53, 0xC4, 0xF5, 0xA6, 0x97, 0xB9, 0x88, 0xDB, 0xEA, 0x7D, 0x4C, 0x1F, 0x2E,
+};
+#endif
+
+#if CRC8_BACKEND == CRC8_BACKEND_GPCRC
+static bool crc8_gpcrc_ok = false; // the GPCRC gave the known answer at crc8_open()
+#endif
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+#if CRC8_BACKEND != CRC8_BACKEND_TABLE
+/***************************************************************************/
+/**
+ * @brief
+ *   CRC-8 with the nibble table
+ *
+ ******************************************************************************/
+static uint8_t crc8_nibble(const uint8_t *data, uint32_t len){
+  uint8_t crc = CRC8_INIT;
+  uint32_t i;
+
+  for(i = 0; i < len; i++){
+      crc ^= data[i];
+      crc = (uint8_t)(crc << 4) ^ crc8_nibble_table[crc >> 4];
+      crc = (uint8_t)(crc << 4) ^ crc8_nibble_table[crc >> 4];
+  }
+  return crc;
+}
+#endif
+
+#if CRC8_BACKEND == CRC8_BACKEND_GPCRC
+/***************************************************************************/
+/**
+ * @brief
+ *   CRC-8 on the GPCRC
+ *
+ * @note
+ *   The GPCRC is one shared peripheral, so it is computed in a critical section.
+ *
+ ******************************************************************************/
+static uint8_t crc8_gpcrc(const uint8_t *data, uint32_t len){
+  uint8_t crc;
+  uint32_t i;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  GPCRC_Start(GPCRC);
+  for(i = 0; i < len; i++){
+      GPCRC_InputU8(GPCRC, data[i]);
+  }
+  crc = (uint8_t)(GPCRC_DataReadBitReversed(GPCRC) >> 8);
+  CORE_EXIT_CRITICAL();
+
+  return crc;
+}
+#endif
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Opens the CRC backend
+ *
+ * @details
+ *  Only the GPCRC backend has anything to set up. The polynomial is shifted up a byte so the 16 bit CRC of the data
+ *  carries the CRC-8 in its upper byte and zero in the lower one. Input bits are reversed and the result is read bit
+ *  reversed, which makes the LSB first peripheral compute the MSB first CRC.
+ *
+ *  The setup depends on how the peripheral handles the bit reversal, so the datasheet example is run through it. On
+ *  a wrong answer the GPCRC is switched off and crc8_compute() uses the nibble table instead.
+ *
+ ******************************************************************************/
+void crc8_open(void){
+#if CRC8_BACKEND == CRC8_BACKEND_GPCRC
+  GPCRC_Init_TypeDef gpcrc_init = GPCRC_INIT_DEFAULT;
+  static const uint8_t check[2] = { CRC8_CHECK_MSB, CRC8_CHECK_LSB };
+
+  CMU_ClockEnable(cmuClock_GPCRC, true);
+  gpcrc_init.crcPoly = CRC8_GPCRC_POLY;
+  gpcrc_init.initValue = CRC8_GPCRC_INIT;
+  gpcrc_init.reverseBits = true;
+  gpcrc_init.enableByteMode = true;
+  gpcrc_init.autoInit = false;
+  gpcrc_init.enable = true;
+  GPCRC_Init(GPCRC, &gpcrc_init);
+
+  crc8_gpcrc_ok = (crc8_gpcrc(check, sizeof(check)) == CRC8_CHECK_CRC);
+  if(!crc8_gpcrc_ok){
+      GPCRC_Enable(GPCRC, false);
+      CMU_ClockEnable(cmuClock_GPCRC, false);
+  }
+#endif
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   CRC-8 of a byte string
+ *
+ * @details
+ *  The Sensirion sensors send this CRC after every 16 bit word, computed over the two word bytes.
+ *
+ * @note
+ *   The GPCRC backend falls back on the nibble table if the GPCRC failed its check at crc8_open().
+ *
+ * @param[in] data
+ *   Bytes to check, in bus order
+ *
+ * @param[in] len
+ *   Number of bytes
+ *
+ * @return
+ *   The CRC
+ *
+ ******************************************************************************/
+uint8_t crc8_compute(const uint8_t *data, uint32_t len){
+#if CRC8_BACKEND == CRC8_BACKEND_TABLE
+  uint8_t crc = CRC8_INIT;
+  uint32_t i;
+
+  for(i = 0; i < len; i++){
+      crc = crc8_table[crc ^ data[i]];
+  }
+  return crc;
+#elif CRC8_BACKEND == CRC8_BACKEND_NIBBLE
+  return crc8_nibble(data, len);
+#elif CRC8_BACKEND == CRC8_BACKEND_GPCRC
+  if(!crc8_gpcrc_ok){
+      return crc8_nibble(data, len);
+  }
+  return crc8_gpcrc(data, len);
+#else
+#error "CRC8_BACKEND must be one of the CRC8_BACKEND_ values"
+#endif
+}
@@ -69,11 +69,7 @@ void gpio_open(void){
   NVIC_EnableIRQ(GPIO_ODD_IRQn);
   NVIC_EnableIRQ(GPIO_EVEN_IRQn);
 
-  GPIO_DriveStrengthSet(SI7021_SENSOR_EN_PORT, gpioDriveStrengthWeakAlternateWeak);
-  GPIO_PinModeSet(SI7021_SENSOR_EN_PORT, SI7021_SENSOR_EN_PIN, gpioModePushPull, 1);
-
-  GPIO_PinModeSet(SI7021_SCL_PORT, SI7021_SCL_PIN, gpioModeWiredAnd, 1);
-  GPIO_PinModeSet(SI7021_SDA_PORT, SI7021_SDA_PIN, gpioModeWiredAnd, 1);
+  // the Si7021 enable and bus pins are driven by sensor_power.c
  //7
   //9
   GPIO_PinModeSet(SH_SCL_Port, SH_SCL_Pin, gpioModeWiredAnd, 1);
@@ -99,9 +95,11 @@ void gpio_open(void){
 void GPIO_ODD_IRQHandler(void){
 
   uint32_t int_flag;
+  PROFILE_START(PROFILE_GPIO_ODD_IRQ);
   int_flag = (GPIO->IF) & (GPIO->IEN);
   GPIO->IFC = int_flag;
   add_scheduled_events(gpio_even_irq_cb);
+  PROFILE_STOP(PROFILE_GPIO_ODD_IRQ);
 
 }
 
@@ -119,8 +117,10 @@ void GPIO_ODD_IRQHandler(void){
  ******************************************************************************/
 void GPIO_EVEN_IRQHandler(void){
   uint32_t int_flag;
+  PROFILE_START(PROFILE_GPIO_EVEN_IRQ);
   int_flag = (GPIO->IF) & (GPIO->IEN);
   GPIO->IFC = int_flag;
   add_scheduled_events(gpio_odd_irq_cb);
+  PROFILE_STOP(PROFILE_GPIO_EVEN_IRQ);
 
 }
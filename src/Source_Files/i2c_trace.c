@@ -0,0 +1,188 @@
+/**
+ * @file i2c_trace.c
+ * @author Max Kilcoyne
+ * @brief Timestamped ring buffer of the I2C state machine events
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "i2c_trace.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+#ifdef I2C_TRACE_ENABLE
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+static I2C_TRACE_ENTRY i2c_trace_buffer[I2C_TRACE_SIZE];
+static uint32_t i2c_trace_head;       // next entry written
+static uint32_t i2c_trace_count;      // valid entries, up to I2C_TRACE_SIZE
+static uint32_t i2c_trace_dropped;    // entries overwritten before they were copied out
+static bool i2c_trace_opened = false;
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Starts the trace timestamp timer and empties the trace
+ *
+ * @details
+ *  I2C_TRACE_TIMER free runs as an up counter for the whole 32 bit range. It only counts while HFPERCLK runs, which
+ *  covers every transaction since the driver blocks EM2 while the bus is busy.
+ *
+ * @note
+ *   Called from i2c_open(), opening a second bus leaves the timer and the trace as they are.
+ *
+ ******************************************************************************/
+void i2c_trace_open(void){
+  TIMER_Init_TypeDef trace_timer_init = TIMER_INIT_DEFAULT;
+
+  if(i2c_trace_opened){
+      return;
+  }
+
+  CMU_ClockEnable(I2C_TRACE_TIMER_CLK, true);
+  trace_timer_init.enable = false;
+  trace_timer_init.debugRun = false;
+  trace_timer_init.oneShot = false;
+  trace_timer_init.mode = timerModeUp;
+  trace_timer_init.prescale = I2C_TRACE_PRESC;
+  TIMER_Init(I2C_TRACE_TIMER, &trace_timer_init);
+  TIMER_TopSet(I2C_TRACE_TIMER, 0xFFFFFFFF);
+  TIMER_Enable(I2C_TRACE_TIMER, true);
+
+  i2c_trace_clear();
+  i2c_trace_opened = true;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Adds one entry to the trace
+ *
+ * @details
+ *  Safe from interrupt and thread context. The oldest entry is overwritten when the trace is full, so the trace
+ *  always holds the most recent I2C_TRACE_SIZE events, and the overwrite is counted as dropped.
+ *
+ * @note
+ *   The driver calls this through the I2C_TRACE() macro, so the calls disappear with I2C_TRACE_ENABLE. Interrupts
+ *   are masked for the two counter reads and the 16 byte store, about 40 cycles or 1.3 us at 32 MHz, a few per
+ *   transaction. PROFILE_I2C_TRACE measures it on the target.
+ *
+ * @param[in] bus
+ *   I2C instance of the event
+ *
+ * @param[in] type
+ *   What happened
+ *
+ * @param[in] state
+ *   State of the bus state machine
+ *
+ * @param[in] arg
+ *   Event detail, see I2C_TRACE_TYPE
+ *
+ ******************************************************************************/
+void i2c_trace_record(uint32_t bus, I2C_TRACE_TYPE type, uint32_t state, uint32_t arg){
+  I2C_TRACE_ENTRY *entry;
+
+  PROFILE_START(PROFILE_I2C_TRACE);
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  entry = &i2c_trace_buffer[i2c_trace_head];
+  entry->time = I2C_TRACE_TIMER->CNT;
+  entry->rtcc = rtcc_get_count();
+  entry->bus = bus;
+  entry->type = type;
+  entry->state = state;
+  entry->arg = arg;
+  i2c_trace_head = (i2c_trace_head + 1) % I2C_TRACE_SIZE;
+  if(i2c_trace_count < I2C_TRACE_SIZE){
+      i2c_trace_count++;
+  }
+  else{
+      i2c_trace_dropped++;
+  }
+  CORE_EXIT_CRITICAL();
+  PROFILE_STOP(PROFILE_I2C_TRACE);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Copies the trace out, oldest entry first
+ *
+ * @details
+ *  The copied entries are removed from the trace, so repeated calls stream it without duplicates. The copy runs
+ *  in a critical section, keep maxEntries small when called with the buses active.
+ *
+ * @param[out] out
+ *   Buffer of at least maxEntries entries
+ *
+ * @param[in] maxEntries
+ *   Largest number of entries to copy
+ *
+ * @param[out] dropped
+ *   If not 0, receives the entries overwritten since the last copy
+ *
+ * @return
+ *   Number of entries copied
+ *
+ ******************************************************************************/
+uint32_t i2c_trace_copy(I2C_TRACE_ENTRY *out, uint32_t maxEntries, uint32_t *dropped){
+  uint32_t tail;
+  uint32_t copied;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  tail = (i2c_trace_head + I2C_TRACE_SIZE - i2c_trace_count) % I2C_TRACE_SIZE;
+  for(copied = 0; copied < maxEntries && copied < i2c_trace_count; copied++){
+      out[copied] = i2c_trace_buffer[(tail + copied) % I2C_TRACE_SIZE];
+  }
+  i2c_trace_count -= copied;
+  if(dropped){
+      *dropped = i2c_trace_dropped;
+  }
+  i2c_trace_dropped = 0;
+  CORE_EXIT_CRITICAL();
+
+  return copied;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Empties the trace
+ *
+ ******************************************************************************/
+void i2c_trace_clear(void){
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  i2c_trace_head = 0;
+  i2c_trace_count = 0;
+  i2c_trace_dropped = 0;
+  CORE_EXIT_CRITICAL();
+}
+
+#endif /* I2C_TRACE_ENABLE */
@@ -246,6 +246,7 @@ else{
 
 void LETIMER0_IRQHandler(void){
   uint32_t int_flag;
+  PROFILE_START(PROFILE_LETIMER0_IRQ);
   int_flag = (LETIMER0->IF) & (LETIMER0->IEN);
   LETIMER0->IFC = int_flag;
 
@@ -294,6 +295,7 @@ void LETIMER0_IRQHandler(void){
 //  int_flag = (LETIMER_IF_UF) & (LETIMER_IEN_UF);
 //  LETIMER0->IFC = int_flag;
 //  EFM_ASSERT(!(LETIMER_IF_UF & LETIMER0->IF));
+  PROFILE_STOP(PROFILE_LETIMER0_IRQ);
 
 
 
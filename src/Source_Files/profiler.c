@@ -0,0 +1,141 @@
+/**
+ * @file profiler.c
+ * @author Max Kilcoyne
+ * @brief Cycle counts of the ISRs and scheduled callbacks on the DWT cycle counter
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "profiler.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+#ifdef PROFILE_ENABLE
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+typedef struct{
+  uint32_t calls;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+}PROFILE_ENTRY;
+
+static PROFILE_ENTRY profile_table[PROFILE_NUM_IDS];
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Starts the DWT cycle counter and empties the table
+ *
+ * @details
+ *  The counter runs at the core clock and stops while the core sleeps, so the brackets count the cycles the CPU
+ *  spent in the ISR or callback, including any interrupt that preempted it.
+ *
+ ******************************************************************************/
+void profiler_open(void){
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  profiler_clear();
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Adds one bracketed run to the table
+ *
+ * @note
+ *   Called through PROFILE_STOP(), from interrupt and thread context.
+ *
+ * @param[in] id
+ *   The ISR or callback that ran
+ *
+ * @param[in] cycles
+ *   Cycles between its PROFILE_START() and PROFILE_STOP()
+ *
+ ******************************************************************************/
+void profiler_record(PROFILE_ID id, uint32_t cycles){
+  PROFILE_ENTRY *entry;
+
+  EFM_ASSERT(id < PROFILE_NUM_IDS);
+  entry = &profile_table[id];
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  if(entry->calls == 0 || cycles < entry->minCycles){
+      entry->minCycles = cycles;
+  }
+  if(cycles > entry->maxCycles){
+      entry->maxCycles = cycles;
+  }
+  entry->totalCycles += cycles;
+  entry->calls++;
+  CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Dumps the table
+ *
+ * @param[out] report
+ *   PROFILE_NUM_IDS entries indexed by PROFILE_ID, filled with the call count and the min, max and mean cycles of
+ *   each one since profiler_open() or the last profiler_clear()
+ *
+ ******************************************************************************/
+void profiler_report(PROFILE_REPORT *report){
+  uint32_t i;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  for(i = 0; i < PROFILE_NUM_IDS; i++){
+      report[i].calls = profile_table[i].calls;
+      report[i].minCycles = profile_table[i].minCycles;
+      report[i].maxCycles = profile_table[i].maxCycles;
+      report[i].meanCycles = profile_table[i].calls ? (uint32_t)(profile_table[i].totalCycles / profile_table[i].calls) : 0;
+  }
+  CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Empties the table
+ *
+ ******************************************************************************/
+void profiler_clear(void){
+  PROFILE_ENTRY cleared = { 0 };
+  uint32_t i;
+
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  for(i = 0; i < PROFILE_NUM_IDS; i++){
+      profile_table[i] = cleared;
+  }
+  CORE_EXIT_CRITICAL();
+}
+
+#endif /* PROFILE_ENABLE */
@@ -0,0 +1,360 @@
+/**
+ * @file rtcc.c
+ * @author Max Kilcoyne
+ * @brief Low frequency compare delays on the RTCC
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "rtcc.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+// min-heap of the armed timers ordered by deadline, the root is the one programmed into RTCC_TIMER_CH
+static RTCC_TIMER *rtcc_heap[RTCC_MAX_TIMERS];
+static uint32_t rtcc_heap_count;
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   true if timer a expires before timer b, correct across the counter wrap
+ *
+ ******************************************************************************/
+static bool rtcc_before(const RTCC_TIMER *a, const RTCC_TIMER *b){
+  return (int32_t)(a->deadline - b->deadline) < 0;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Puts a timer at a heap position
+ *
+ ******************************************************************************/
+static void rtcc_heap_place(RTCC_TIMER *timer, uint32_t pos){
+  rtcc_heap[pos] = timer;
+  timer->index = pos + 1;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Moves the timer at pos towards the root until its parent expires first
+ *
+ ******************************************************************************/
+static void rtcc_sift_up(uint32_t pos){
+  RTCC_TIMER *timer = rtcc_heap[pos];
+  uint32_t parent;
+
+  while(pos > 0){
+      parent = (pos - 1) / 2;
+      if(!rtcc_before(timer, rtcc_heap[parent])){
+          break;
+      }
+      rtcc_heap_place(rtcc_heap[parent], pos);
+      pos = parent;
+  }
+  rtcc_heap_place(timer, pos);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Moves the timer at pos towards the leaves until both children expire after it
+ *
+ ******************************************************************************/
+static void rtcc_sift_down(uint32_t pos){
+  RTCC_TIMER *timer = rtcc_heap[pos];
+  uint32_t child;
+
+  while((child = 2 * pos + 1) < rtcc_heap_count){
+      if(child + 1 < rtcc_heap_count && rtcc_before(rtcc_heap[child + 1], rtcc_heap[child])){
+          child++;
+      }
+      if(!rtcc_before(rtcc_heap[child], timer)){
+          break;
+      }
+      rtcc_heap_place(rtcc_heap[child], pos);
+      pos = child;
+  }
+  rtcc_heap_place(timer, pos);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Adds an idle timer to the heap, call inside a critical section
+ *
+ * @details
+ *  The EM block is held while any timer is armed, the ULFRCO does not run the RTCC in EM4.
+ *
+ ******************************************************************************/
+static void rtcc_heap_insert(RTCC_TIMER *timer){
+  EFM_ASSERT(rtcc_heap_count < RTCC_MAX_TIMERS);
+
+  if(rtcc_heap_count == 0){
+      sleep_block_mode(RTCC_EM);
+  }
+  rtcc_heap_place(timer, rtcc_heap_count);
+  rtcc_heap_count++;
+  rtcc_sift_up(timer->index - 1);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Takes an armed timer out of the heap, call inside a critical section
+ *
+ ******************************************************************************/
+static void rtcc_heap_remove(RTCC_TIMER *timer){
+  uint32_t pos = timer->index - 1;
+  RTCC_TIMER *last;
+
+  rtcc_heap_count--;
+  last = rtcc_heap[rtcc_heap_count];
+  timer->index = RTCC_TIMER_IDLE;
+  if(pos != rtcc_heap_count){
+      rtcc_heap_place(last, pos);
+      rtcc_sift_up(pos);
+      rtcc_sift_down(last->index - 1);
+  }
+  if(rtcc_heap_count == 0){
+      sleep_unblock_mode(RTCC_EM);
+  }
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Converts ms to RTCC ticks without overflowing the product
+ *
+ * @details
+ *  Deadlines are compared as signed differences, so a delay must stay below 2^31 ticks, about 24 days at 1 kHz.
+ *
+ ******************************************************************************/
+static uint32_t rtcc_ms_to_ticks(uint32_t ms){
+  uint64_t ticks = ((uint64_t)ms * RTCC_HZ) / 1000;
+
+  EFM_ASSERT(ticks < RTCC_MAX_TICKS);
+  return (uint32_t)ticks;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Programs the compare channel with the earliest deadline, call inside a critical section
+ *
+ * @details
+ *  The compare only matches on equality, so a deadline already reached is moved two ticks ahead instead of being
+ *  missed until the counter wraps. The counter can still pass the compare value while it is written, so it is read
+ *  again afterwards and a deadline already reached raises the compare interrupt by software. With no timer armed
+ *  the channel interrupt is off and nothing wakes the MCU.
+ *
+ ******************************************************************************/
+static void rtcc_program(void){
+  uint32_t next;
+  uint32_t now;
+
+  if(rtcc_heap_count == 0){
+      RTCC_IntDisable(RTCC_IF_CC0 << RTCC_TIMER_CH);
+      RTCC_IntClear(RTCC_IF_CC0 << RTCC_TIMER_CH);
+      return;
+  }
+  now = RTCC_CounterGet();
+  next = rtcc_heap[0]->deadline;
+  if((int32_t)(next - (now + RTCC_MIN_AHEAD)) < 0){
+      next = now + RTCC_MIN_AHEAD;
+  }
+  RTCC_ChannelCCVSet(RTCC_TIMER_CH, next);
+  RTCC_IntEnable(RTCC_IF_CC0 << RTCC_TIMER_CH);
+  if((int32_t)(next - RTCC_CounterGet()) <= 0){
+      RTCC_IntSet(RTCC_IF_CC0 << RTCC_TIMER_CH);
+  }
+}
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************//**
+ *@author Max Kilcoyne
+ *
+ * @brief
+ *   Opens the RTCC as a free running 1 kHz counter
+ *
+ * @details
+ *   The LFE clock tree must already be routed to the ULFRCO, see cmu_open(). All software timers share the one
+ *   compare channel RTCC_TIMER_CH, which is always set to the earliest deadline, so the MCU sleeps until the next
+ *   timer with no periodic tick.
+ *
+ * @note
+ *   The counter is never reset, deadlines are taken relative to the current count.
+ *
+ ******************************************************************************/
+void rtcc_open(void){
+  RTCC_Init_TypeDef rtcc_values = RTCC_INIT_DEFAULT;
+  RTCC_CCChConf_TypeDef rtcc_compare = RTCC_CH_INIT_COMPARE_DEFAULT;
+
+  CMU_ClockEnable(cmuClock_RTCC, true);
+
+  rtcc_values.enable = false;
+  rtcc_values.debugRun = false;
+  rtcc_values.presc = rtccCntPresc_1;
+  RTCC_Init(&rtcc_values);
+
+  RTCC_ChannelInit(RTCC_TIMER_CH, &rtcc_compare);
+  rtcc_heap_count = 0;
+
+  RTCC_IntClear(_RTCC_IF_MASK);
+  NVIC_EnableIRQ(RTCC_IRQn);
+
+  RTCC_Enable(true);
+}
+
+/***************************************************************************//**
+ *@author Max Kilcoyne
+ *
+ * @brief
+ *   Arms a software timer
+ *
+ * @details
+ *   The callback is called from the RTCC interrupt. Starting a timer that is already armed replaces its deadline.
+ *   Insertion and removal are O(log n) in the armed timers.
+ *
+ * @note
+ *   The first delay is rounded up by one tick so it is never shorter than asked for. Periodic expiries follow at
+ *   exact multiples of the period from it, so they do not drift with interrupt latency.
+ *
+ * @param[in] timer
+ *   Timer owned by the caller, it must stay in memory while armed
+ *
+ * @param[in] ms
+ *   Delay to the first expiry in milliseconds
+ *
+ * @param[in] period_ms
+ *   Time between later expiries in milliseconds, 0 for a one shot
+ *
+ * @param[in] callback
+ *   Function called from interrupt context when the timer expires
+ *
+ * @param[in] arg
+ *   Passed to the callback
+ *
+ ******************************************************************************/
+void rtcc_timer_start(RTCC_TIMER *timer, uint32_t ms, uint32_t period_ms, RTCC_CALLBACK callback, void *arg){
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  if(timer->index != RTCC_TIMER_IDLE){
+      rtcc_heap_remove(timer);
+  }
+  timer->deadline = RTCC_CounterGet() + rtcc_ms_to_ticks(ms) + 1;
+  timer->period = rtcc_ms_to_ticks(period_ms);
+  timer->callback = callback;
+  timer->arg = arg;
+  rtcc_heap_insert(timer);
+  rtcc_program();
+  CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ *@author Max Kilcoyne
+ *
+ * @brief
+ *   Disarms a software timer without calling back, stopping an idle timer does nothing
+ *
+ * @param[in] timer
+ *   Timer to stop
+ *
+ ******************************************************************************/
+void rtcc_timer_stop(RTCC_TIMER *timer){
+  CORE_DECLARE_IRQ_STATE;
+  CORE_ENTER_CRITICAL();
+  if(timer->index != RTCC_TIMER_IDLE){
+      rtcc_heap_remove(timer);
+      rtcc_program();
+  }
+  CORE_EXIT_CRITICAL();
+}
+
+/***************************************************************************//**
+ *@author Max Kilcoyne
+ *
+ * @brief
+ *   true while the timer is armed
+ *
+ ******************************************************************************/
+bool rtcc_timer_armed(const RTCC_TIMER *timer){
+  return timer->index != RTCC_TIMER_IDLE;
+}
+
+/***************************************************************************//**
+ *@author Max Kilcoyne
+ *
+ * @brief
+ *   Returns the free running RTCC count in 1 / RTCC_HZ ticks
+ *
+ ******************************************************************************/
+uint32_t rtcc_get_count(void){
+  return RTCC_CounterGet();
+}
+
+/***************************************************************************//**
+ *@author Max Kilcoyne
+ *
+ * @brief This is the Interrupt service routine function for the RTCC
+ *
+ * @details
+ * Every timer whose deadline has been reached is taken off the heap before its callback runs, so the callback can
+ * start or stop any timer, itself included. A periodic timer is put back with its next deadline first, one that
+ * fell more than a period behind restarts a period from now instead of calling back for each missed expiry.
+ *
+ * @param[in] void
+ *
+ ******************************************************************************/
+void RTCC_IRQHandler(void){
+  uint32_t int_flag;
+  RTCC_TIMER *timer;
+  uint32_t now;
+  PROFILE_START(PROFILE_RTCC_IRQ);
+  int_flag = RTCC->IF & RTCC->IEN;
+  RTCC->IFC = int_flag;
+
+  now = RTCC_CounterGet();
+  while(rtcc_heap_count > 0 && (int32_t)(rtcc_heap[0]->deadline - now) <= 0){
+      timer = rtcc_heap[0];
+      rtcc_heap_remove(timer);
+      if(timer->period){
+          timer->deadline += timer->period;
+          if((int32_t)(timer->deadline - now) <= 0){
+              timer->deadline = now + timer->period;
+          }
+          rtcc_heap_insert(timer);
+      }
+      if(timer->callback){
+          timer->callback(timer->arg);
+      }
+      now = RTCC_CounterGet();
+  }
+  rtcc_program();
+  PROFILE_STOP(PROFILE_RTCC_IRQ);
+}
@@ -0,0 +1,154 @@
+/**
+ * @file sample_queue.c
+ * @author Max Kilcoyne
+ * @brief Hands measurements from the I2C interrupts to the main loop, one single producer single consumer ring per sensor
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+#include "em_device.h"
+
+//** User/developer include files
+#include "sample_queue.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+// orders the record copy against the index store that publishes or frees it
+// DMB on the Cortex-M, a C11 fence on other targets
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+#define SAMPLE_QUEUE_BARRIER()    __DMB()
+#else
+#include <stdatomic.h>
+#define SAMPLE_QUEUE_BARRIER()    atomic_thread_fence(memory_order_seq_cst)
+#endif
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+// head and tail run free and wrap on the uint32_t, head - tail is the fill level
+// the interrupt of the sensor bus only writes head, the main loop only writes tail, so neither needs a lock
+typedef struct{
+  SAMPLE_RECORD records[SAMPLE_QUEUE_SIZE];
+  volatile uint32_t head;
+  volatile uint32_t tail;
+  uint32_t dropped;     // records posted while the ring was full, written by the producer only
+}SAMPLE_QUEUE;
+
+static SAMPLE_QUEUE sample_queues[SENSOR_NUM_IDS];
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Empties every ring
+ *
+ * @note
+ *  Call before the sensor buses are opened.
+ *
+ ******************************************************************************/
+void sample_queue_open(void){
+  uint32_t i;
+
+  for(i = 0; i < SENSOR_NUM_IDS; i++){
+      sample_queues[i].head = 0;
+      sample_queues[i].tail = 0;
+      sample_queues[i].dropped = 0;
+  }
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Posts a record to the ring of its sensor
+ *
+ * @details
+ *  Producer side, called from the interrupt that ends a measurement on the bus of the sensor. The record is
+ *  copied into the slot before head is moved past it, so the main loop never sees a half written record. A full
+ *  ring keeps the records it holds and counts the new one as dropped.
+ *
+ * @param[in] record
+ *  Record to copy, its sensor field picks the ring
+ *
+ * @return
+ *  false if the ring was full and the record was dropped
+ *
+ ******************************************************************************/
+bool sample_queue_post(const SAMPLE_RECORD *record){
+  SAMPLE_QUEUE *queue;
+  uint32_t head;
+
+  EFM_ASSERT(record->sensor < SENSOR_NUM_IDS);
+  queue = &sample_queues[record->sensor];
+
+  head = queue->head;
+  if(head - queue->tail >= SAMPLE_QUEUE_SIZE){
+      queue->dropped++;
+      return false;
+  }
+  queue->records[head & SAMPLE_QUEUE_MASK] = *record;
+  SAMPLE_QUEUE_BARRIER();
+  queue->head = head + 1;
+  return true;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Takes the oldest record of a sensor
+ *
+ * @details
+ *  Consumer side, called from the main loop. The slot is copied out before tail frees it for the producer.
+ *
+ * @param[in] sensor
+ *  Ring to read
+ *
+ * @param[out] record
+ *  The oldest record
+ *
+ * @return
+ *  false if the ring was empty
+ *
+ ******************************************************************************/
+bool sample_queue_get(SENSOR_ID sensor, SAMPLE_RECORD *record){
+  SAMPLE_QUEUE *queue;
+  uint32_t tail;
+
+  EFM_ASSERT(sensor < SENSOR_NUM_IDS);
+  queue = &sample_queues[sensor];
+
+  tail = queue->tail;
+  if(tail == queue->head){
+      return false;
+  }
+  SAMPLE_QUEUE_BARRIER();
+  *record = queue->records[tail & SAMPLE_QUEUE_MASK];
+  SAMPLE_QUEUE_BARRIER();
+  queue->tail = tail + 1;
+  return true;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *  Records of a sensor dropped on a full ring since the queues were opened
+ *
+ ******************************************************************************/
+uint32_t sample_queue_dropped(SENSOR_ID sensor){
+  EFM_ASSERT(sensor < SENSOR_NUM_IDS);
+  return sample_queues[sensor].dropped;
+}
@@ -11,14 +11,67 @@
 #include "em_assert.h"
 #include "em_core.h"
 #include "em_emu.h"
+#include "profiler.h"
 
 
+// count trailing zeros, RBIT and CLZ on the Cortex-M4
+#define SCHEDULER_CTZ(x)    ((uint32_t)__builtin_ctz(x))
+
+// pending words are changed with atomic read-modify-writes instead of masking interrupts
+// LDREX/STREX on the Cortex-M, where an exception between the two clears the monitor and the store is retried,
+// C11 atomics on other targets
+#if defined(__ARM_ARCH_7M__) || defined(__ARM_ARCH_7EM__)
+typedef volatile uint32_t SCHEDULER_WORD;
+
+static inline void scheduler_atomic_or(SCHEDULER_WORD *word, uint32_t bits){
+  uint32_t value;
+
+  do{
+      value = __LDREXW(word) | bits;
+  }while(__STREXW(value, word));
+}
+
+static inline void scheduler_atomic_clear(SCHEDULER_WORD *word, uint32_t bits){
+  uint32_t value;
+
+  do{
+      value = __LDREXW(word) & ~bits;
+  }while(__STREXW(value, word));
+}
+
+#define SCHEDULER_LOAD(word)    (*(word))
+#else
+#include <stdatomic.h>
+typedef _Atomic uint32_t SCHEDULER_WORD;
+
+static inline void scheduler_atomic_or(SCHEDULER_WORD *word, uint32_t bits){
+  atomic_fetch_or(word, bits);
+}
+
+static inline void scheduler_atomic_clear(SCHEDULER_WORD *word, uint32_t bits){
+  atomic_fetch_and(word, ~bits);
+}
+
+#define SCHEDULER_LOAD(word)    atomic_load(word)
+#endif
 
 
 
 //static Variables;
 
-static uint32_t event_scheduled;
+// pending events twice: by event id for the mask functions, and by handler slot for the dispatch
+// the slots are kept in priority order, so the lowest set slot bit is the most urgent pending handler
+// the two are updated one after the other, a post sets the slot bit first and a clear clears it first, so an event
+// can be seen in one and not the other for a moment and scheduler_pending() checks both
+static SCHEDULER_WORD event_scheduled[SCHEDULER_WORDS];
+static SCHEDULER_WORD slot_scheduled[SCHEDULER_WORDS];
+
+static uint8_t event_slot[SCHEDULER_MAX_EVENTS];   // slot of each event id, SCHEDULER_NO_SLOT if not registered
+static uint8_t slot_event[SCHEDULER_MAX_EVENTS];
+static uint32_t slot_priority[SCHEDULER_MAX_EVENTS];
+static SCHEDULER_HANDLER slot_handler[SCHEDULER_MAX_EVENTS];
+static uint32_t slot_profile[SCHEDULER_MAX_EVENTS];
+static uint32_t num_slots;
 
 /*
  * This function lets the clearing of an event take priorit over everything else so that it can complete it's function before any
@@ -36,32 +89,215 @@ function or event
 //
 //}
 
+/***************************************************************************/
+/**
+ * @brief
+ *   Marks one event pending, safe from any interrupt level
+ *
+ * @details
+ *  An event without a handler is not marked, scheduler_dispatch() could never clear it and scheduler_pending()
+ *  would keep the main loop out of sleep for good.
+ *
+ *  The slot bit is set before the event bit, the reverse of scheduler_clear(), so a post racing a dispatch never
+ *  leaves an event marked with no handler run still owed to it.
+ *
+ ******************************************************************************/
+static void scheduler_set(uint32_t event_id){
+  uint32_t slot = event_slot[event_id];
+
+  EFM_ASSERT(slot != SCHEDULER_NO_SLOT);
+  if(slot == SCHEDULER_NO_SLOT){
+      return;
+  }
+  scheduler_atomic_or(&slot_scheduled[slot >> 5], 1u << (slot & 31));
+  scheduler_atomic_or(&event_scheduled[event_id >> 5], 1u << (event_id & 31));
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Clears one pending event, safe from any interrupt level
+ *
+ * @details
+ *  A post landing between the two clears leaves the slot bit set, so the handler runs once more, the same as a post
+ *  right after the clear.
+ *
+ ******************************************************************************/
+static void scheduler_clear(uint32_t event_id){
+  uint32_t slot = event_slot[event_id];
+
+  if(slot != SCHEDULER_NO_SLOT){
+      scheduler_atomic_clear(&slot_scheduled[slot >> 5], 1u << (slot & 31));
+  }
+  scheduler_atomic_clear(&event_scheduled[event_id >> 5], 1u << (event_id & 31));
+}
 
 
 void scheduler_open(void){
+  uint32_t i;
+
   CORE_DECLARE_IRQ_STATE;
   CORE_ENTER_CRITICAL();
-  event_scheduled = 0;
+  for(i = 0; i < SCHEDULER_WORDS; i++){
+      event_scheduled[i] = 0;
+      slot_scheduled[i] = 0;
+  }
+  for(i = 0; i < SCHEDULER_MAX_EVENTS; i++){
+      event_slot[i] = SCHEDULER_NO_SLOT;
+  }
+  num_slots = 0;
   CORE_EXIT_CRITICAL();
 
 }
 void add_scheduled_events(uint32_t event){
-  CORE_DECLARE_IRQ_STATE;
-  CORE_ENTER_CRITICAL();
-  event_scheduled |= event;
-  CORE_EXIT_CRITICAL();
+  while(event){
+      scheduler_set(SCHEDULER_CTZ(event));
+      event &= event - 1;
+  }
 
 }
 void remove_scheduled_events(uint32_t event){
+  while(event){
+      scheduler_clear(SCHEDULER_CTZ(event));
+      event &= event - 1;
+  }
+
+}
+
+uint32_t get_scheduled_events(void){
+
+  return SCHEDULER_LOAD(&event_scheduled[0]);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Registers the handler of an event
+ *
+ * @details
+ *  The handler table is kept sorted by priority, 0 first, with events of equal priority in registration order, so
+ *  scheduler_dispatch() finds the most urgent pending handler with one count trailing zeros per word.
+ *
+ * @note
+ *   Register everything before the first event is posted, from scheduler_open() on, the slots move while the table is
+ *   sorted.
+ *
+ * @param[in] event_id
+ *   Event id below SCHEDULER_MAX_EVENTS
+ *
+ * @param[in] priority
+ *   Dispatch priority, lower runs first
+ *
+ * @param[in] handler
+ *   Function called when the event is dispatched
+ *
+ * @param[in] profile_id
+ *   PROFILE_ID the handler is counted under when the profiler is enabled, SCHEDULER_NO_PROFILE for none
+ *
+ ******************************************************************************/
+void scheduler_register(uint32_t event_id, uint32_t priority, SCHEDULER_HANDLER handler, uint32_t profile_id){
+  uint32_t slot;
+  uint32_t i;
+
+  EFM_ASSERT(event_id < SCHEDULER_MAX_EVENTS);
+  EFM_ASSERT(event_slot[event_id] == SCHEDULER_NO_SLOT);
+  EFM_ASSERT(num_slots < SCHEDULER_MAX_EVENTS);
+  EFM_ASSERT(!scheduler_pending());
+
   CORE_DECLARE_IRQ_STATE;
   CORE_ENTER_CRITICAL();
-  event_scheduled &= ~event;
+  for(slot = num_slots; slot > 0 && slot_priority[slot - 1] > priority; slot--){
+      slot_event[slot] = slot_event[slot - 1];
+      slot_priority[slot] = slot_priority[slot - 1];
+      slot_handler[slot] = slot_handler[slot - 1];
+      slot_profile[slot] = slot_profile[slot - 1];
+  }
+  slot_event[slot] = event_id;
+  slot_priority[slot] = priority;
+  slot_handler[slot] = handler;
+  slot_profile[slot] = profile_id;
+  num_slots++;
+  for(i = slot; i < num_slots; i++){
+      event_slot[slot_event[i]] = i;
+  }
   CORE_EXIT_CRITICAL();
+}
 
+/***************************************************************************/
+/**
+ * @brief
+ *   Posts an event by id, for the events above the 32 of add_scheduled_events()
+ *
+ * @param[in] event_id
+ *   Event id below SCHEDULER_MAX_EVENTS
+ *
+ ******************************************************************************/
+void scheduler_post(uint32_t event_id){
+  EFM_ASSERT(event_id < SCHEDULER_MAX_EVENTS);
+
+  scheduler_set(event_id);
 }
 
-uint32_t get_scheduled_events(void){
+/***************************************************************************/
+/**
+ * @brief
+ *   true while any event is pending, the main loop only sleeps when this is false
+ *
+ ******************************************************************************/
+bool scheduler_pending(void){
+  uint32_t i;
 
-  return event_scheduled;
+  for(i = 0; i < SCHEDULER_WORDS; i++){
+      if(SCHEDULER_LOAD(&event_scheduled[i]) | SCHEDULER_LOAD(&slot_scheduled[i])){
+          return true;
+      }
+  }
+  return false;
 }
 
+/***************************************************************************/
+/**
+ * @brief
+ *   Runs the handler of the most urgent pending event
+ *
+ * @details
+ *  The event is cleared before its handler runs, so the handler can post it again. One handler runs per call and
+ *  the search starts over from the highest priority, so an event posted by an interrupt during a handler is not
+ *  held behind lower priority ones. The cost is one word test per SCHEDULER_WORDS and a count trailing zeros,
+ *  however many events are registered. The main loop calls it until scheduler_pending() is false.
+ *
+ ******************************************************************************/
+void scheduler_dispatch(void){
+  uint32_t word;
+  uint32_t pending;
+  uint32_t slot = SCHEDULER_NO_SLOT;
+  SCHEDULER_HANDLER handler;
+  uint32_t profile;
+
+  // slot bits are only cleared from the main loop, so a bit seen set stays set until the clear below
+  for(word = 0; word < SCHEDULER_WORDS; word++){
+      pending = SCHEDULER_LOAD(&slot_scheduled[word]);
+      if(pending){
+          slot = (word << 5) + SCHEDULER_CTZ(pending);
+          break;
+      }
+  }
+  if(slot == SCHEDULER_NO_SLOT){
+      return;
+  }
+  scheduler_clear(slot_event[slot]);
+  handler = slot_handler[slot];
+  profile = slot_profile[slot];
+
+#ifdef PROFILE_ENABLE
+  if(profile != SCHEDULER_NO_PROFILE){
+      uint32_t start = PROFILER_CYCLES();
+      handler();
+      profiler_record((PROFILE_ID)profile, PROFILER_CYCLES() - start);
+      return;
+  }
+#else
+  (void)profile;
+#endif
+  handler();
+}
@@ -0,0 +1,212 @@
+/**
+ * @file sensor_policy.c
+ * @author Max Kilcoyne
+ * @brief Reads one primary sensor every period and cross checks it with the other only when it is worth it
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "sensor_policy.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+static SENSOR_ID policy_primary = SENSOR_SHTC3;
+static uint32_t policy_verify_every = SENSOR_POLICY_VERIFY_EVERY;
+static int32_t policy_rh_alert = SENSOR_POLICY_NO_ALERT;
+static uint32_t policy_periods; // periods since the last cross check
+static bool policy_have_primary; // policy_last holds a primary sample
+static SENSOR_SAMPLE policy_last; // latest primary sample, the secondary is compared against it
+static SENSOR_POLICY_STATS policy_stats;
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Adds one secondary minus primary difference to a running sum, sum of squares and maximum
+ *
+ ******************************************************************************/
+static void policy_accumulate(int32_t diff, int64_t *sum, uint64_t *sumSq, uint32_t *maxAbs){
+  uint32_t mag = conv_abs_diff(diff, 0);
+
+  *sum += diff;
+  *sumSq += (uint64_t)mag * mag;
+  if(mag > *maxAbs){
+      *maxAbs = mag;
+  }
+}
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Sets up the acquisition policy
+ *
+ * @param[in] primary
+ *   Sensor read every period
+ *
+ * @param[in] verify_every
+ *   Periods between cross checks with the secondary while nothing else asks for one, 0 never
+ *
+ * @param[in] rh_alert
+ *   Humidity the application alerts on in centi-percent RH, SENSOR_POLICY_NO_ALERT for none
+ *
+ ******************************************************************************/
+void sensor_policy_open(SENSOR_ID primary, uint32_t verify_every, int32_t rh_alert){
+  EFM_ASSERT(primary < SENSOR_NUM_IDS);
+
+  policy_primary = primary;
+  policy_verify_every = verify_every;
+  policy_rh_alert = rh_alert;
+  policy_periods = 0;
+  policy_have_primary = false;
+  sensor_policy_clear_stats();
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Sensor read every period
+ *
+ ******************************************************************************/
+SENSOR_ID sensor_policy_primary(void){
+  return policy_primary;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Called once per period when the primary is started
+ *
+ * @return
+ *   true if the secondary is read this period as the scheduled cross check
+ *
+ ******************************************************************************/
+bool sensor_policy_period(void){
+  if(policy_verify_every == 0){
+      return false;
+  }
+  policy_periods++;
+  if(policy_periods >= policy_verify_every){
+      policy_periods = 0;
+      return true;
+  }
+  return false;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Takes a sample of the primary sensor
+ *
+ * @details
+ *  A primary that moved more than the SENSOR_POLICY_RATE_ steps since its last sample, or is within
+ *  CONV_ALERT_BAND_CENTI of the alert threshold, asks for a cross check now instead of waiting for the
+ *  scheduled one.
+ *
+ * @param[in] sample
+ *   Primary reading
+ *
+ * @return
+ *   true if the secondary should be read now
+ *
+ ******************************************************************************/
+bool sensor_policy_primary_sample(const SENSOR_SAMPLE *sample){
+  bool fast = false;
+  bool near_alert;
+
+  if(policy_have_primary){
+      fast = conv_abs_diff(sample->rhCenti, policy_last.rhCenti) > SENSOR_POLICY_RATE_RH_CENTI
+          || conv_abs_diff(sample->tempCenti, policy_last.tempCenti) > SENSOR_POLICY_RATE_TEMP_CENTI;
+  }
+  near_alert = (policy_rh_alert != SENSOR_POLICY_NO_ALERT)
+      && conv_abs_diff(sample->rhCenti, policy_rh_alert) <= CONV_ALERT_BAND_CENTI;
+
+  policy_last = *sample;
+  policy_have_primary = true;
+
+  if(fast){
+      policy_stats.rateChecks++;
+  }
+  else if(near_alert){
+      policy_stats.alertChecks++;
+  }
+  else{
+      return false;
+  }
+  policy_periods = 0;
+  return true;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Takes a sample of the secondary sensor and adds its disagreement with the latest primary sample to the stats
+ *
+ * @param[in] sample
+ *   Secondary reading
+ *
+ ******************************************************************************/
+void sensor_policy_secondary_sample(const SENSOR_SAMPLE *sample){
+  if(!policy_have_primary){
+      return;
+  }
+  policy_stats.count++;
+  policy_accumulate(sample->rhCenti - policy_last.rhCenti, &policy_stats.rhSum, &policy_stats.rhSumSq,
+                    &policy_stats.rhMaxAbs);
+  policy_accumulate(sample->tempCenti - policy_last.tempCenti, &policy_stats.tempSum, &policy_stats.tempSumSq,
+                    &policy_stats.tempMaxAbs);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Copies the disagreement statistics
+ *
+ * @param[out] stats
+ *   Where the statistics are copied to
+ *
+ ******************************************************************************/
+void sensor_policy_get_stats(SENSOR_POLICY_STATS *stats){
+  *stats = policy_stats;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Clears the disagreement statistics
+ *
+ ******************************************************************************/
+void sensor_policy_clear_stats(void){
+  policy_stats.count = 0;
+  policy_stats.rateChecks = 0;
+  policy_stats.alertChecks = 0;
+  policy_stats.rhSum = 0;
+  policy_stats.rhSumSq = 0;
+  policy_stats.rhMaxAbs = 0;
+  policy_stats.tempSum = 0;
+  policy_stats.tempSumSq = 0;
+  policy_stats.tempMaxAbs = 0;
+}
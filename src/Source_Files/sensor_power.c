@@ -0,0 +1,181 @@
+/**
+ * @file sensor_power.c
+ * @author Max Kilcoyne
+ * @brief Switches the Si7021 supply through SI7021_SENSOR_EN and waits out its power up on the RTCC
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "sensor_power.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+static SENSOR_POWER_STATE power_state = SENSOR_POWER_OFF;
+static bool power_gated = false; // supply switched off between samples
+static uint32_t power_ready_cb; // events scheduled once the supply is up, ORed while it ramps
+static RTCC_TIMER power_timer;
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   RTCC callback at the end of the power up delay
+ *
+ * @details
+ *  Hands the bus pins back to the I2C and schedules the events waiting for the supply. This runs in the RTCC
+ *  interrupt, so the I2C itself is reset by si7021_power_on() from the main loop.
+ *
+ ******************************************************************************/
+static void sensor_power_ramp_done(void *arg){
+  (void)arg;
+
+  GPIO_PinModeSet(SI7021_SCL_PORT, SI7021_SCL_PIN, gpioModeWiredAnd, 1);
+  GPIO_PinModeSet(SI7021_SDA_PORT, SI7021_SDA_PIN, gpioModeWiredAnd, 1);
+
+  power_state = SENSOR_POWER_ON;
+  add_scheduled_events(power_ready_cb);
+  power_ready_cb = 0;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Turns the supply on and starts the power up delay
+ *
+ ******************************************************************************/
+static void sensor_power_up(void){
+  power_state = SENSOR_POWER_RAMP;
+  GPIO_PinOutSet(SI7021_SENSOR_EN_PORT, SI7021_SENSOR_EN_PIN);
+  rtcc_timer_start(&power_timer, SENSOR_POWER_ON_MS, 0, sensor_power_ramp_done, 0);
+}
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Powers up the sensor and decides if its supply is gated between samples
+ *
+ * @details
+ *  Gating pays once the standby charge over a period is more than the charge of one power up, which with the
+ *  SENSOR_POWER_ constants is a period of about 18 minutes. The power up runs on the RTCC, so the caller returns
+ *  to the scheduler and sleeps instead of blocking for SENSOR_POWER_ON_MS.
+ *
+ * @note
+ *  The RTCC and the GPIO must be open, and the Si7021 I2C is opened after this so its pins are never driven before
+ *  the supply is defined. Nothing may be sent to the sensor before ready_cb is scheduled. At the 3 s LETIMER period
+ *  the supply is never gated, SENSOR_POWER_FORCE_GATED runs the gated path for bring up.
+ *
+ * @param[in] period_ms
+ *   Time between samples in ms
+ *
+ * @param[in] ready_cb
+ *   Event scheduled once the sensor is powered up
+ *
+ ******************************************************************************/
+void sensor_power_open(uint32_t period_ms, uint32_t ready_cb){
+  uint64_t gated_cost;
+  uint64_t standby_cost;
+
+  gated_cost = (uint64_t)SENSOR_POWER_STARTUP_NA * SENSOR_POWER_STARTUP_MS;
+  standby_cost = (uint64_t)SENSOR_POWER_STANDBY_NA * period_ms;
+  power_gated = SENSOR_POWER_FORCE_GATED || standby_cost > gated_cost;
+
+  GPIO_DriveStrengthSet(SI7021_SENSOR_EN_PORT, gpioDriveStrengthWeakAlternateWeak);
+  GPIO_PinModeSet(SI7021_SENSOR_EN_PORT, SI7021_SENSOR_EN_PIN, gpioModePushPull, 0);
+  GPIO_PinModeSet(SI7021_SCL_PORT, SI7021_SCL_PIN, gpioModeDisabled, 0);
+  GPIO_PinModeSet(SI7021_SDA_PORT, SI7021_SDA_PIN, gpioModeDisabled, 0);
+
+  power_ready_cb = ready_cb;
+  sensor_power_up();
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Asks for the sensor supply
+ *
+ * @details
+ *  ready_cb is scheduled at once if the supply is up, otherwise at the end of the power up, started here if the
+ *  supply was off.
+ *
+ * @param[in] ready_cb
+ *   Event scheduled once the sensor can be talked to
+ *
+ ******************************************************************************/
+void sensor_power_request(uint32_t ready_cb){
+  switch(power_state){
+    case SENSOR_POWER_ON:
+      add_scheduled_events(ready_cb);
+      break;
+    case SENSOR_POWER_RAMP:
+      power_ready_cb |= ready_cb;
+      break;
+    case SENSOR_POWER_OFF:
+      power_ready_cb = ready_cb;
+      sensor_power_up();
+      break;
+  }
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Switches the sensor supply off if it is gated
+ *
+ * @details
+ *  Called once the sample is read and the bus is idle. The bus pins are disabled before the supply so the I2C
+ *  does not power the sensor through its pins. Without gating the supply stays on.
+ *
+ ******************************************************************************/
+void sensor_power_release(void){
+  if(!power_gated || power_state != SENSOR_POWER_ON){
+      return;
+  }
+  GPIO_PinModeSet(SI7021_SCL_PORT, SI7021_SCL_PIN, gpioModeDisabled, 0);
+  GPIO_PinModeSet(SI7021_SDA_PORT, SI7021_SDA_PIN, gpioModeDisabled, 0);
+  GPIO_PinOutClear(SI7021_SENSOR_EN_PORT, SI7021_SENSOR_EN_PIN);
+  power_state = SENSOR_POWER_OFF;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   true if the supply is switched off between samples
+ *
+ ******************************************************************************/
+bool sensor_power_gated(void){
+  return power_gated;
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   State of the sensor supply
+ *
+ ******************************************************************************/
+SENSOR_POWER_STATE sensor_power_state(void){
+  return power_state;
+}
@@ -0,0 +1,117 @@
+/**
+ * @file task.c
+ * @author Max Kilcoyne
+ * @brief Stackless threads resumed by scheduler events, with RTCC delays and awaitable driver callbacks
+ *
+ */
+
+
+//***********************************************************************************
+// Include files
+//***********************************************************************************
+
+//** Standard Libraries
+
+//** Silicon Lab include files
+
+//** User/developer include files
+#include "task.h"
+
+//***********************************************************************************
+// defined files
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private variables
+//***********************************************************************************
+
+
+//***********************************************************************************
+// Private functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   RTCC callback at the end of a TASK_DELAY
+ *
+ * @param[in] arg
+ *   The task waiting on the delay
+ *
+ ******************************************************************************/
+static void task_delay_done(void *arg){
+  task_signal((TASK *)arg);
+}
+
+
+//***********************************************************************************
+// Global functions
+//***********************************************************************************
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Binds a task to its scheduler event and runs its thread up to the first wait
+ *
+ * @details
+ *  The handler registered for event_id calls the thread with the task. A driver callback or RTCC expiry aimed at
+ *  the thread is the event mask returned by task_event(), so a wait on it costs no event of its own.
+ *
+ * @note
+ *  The scheduler must be open and the handler registered.
+ *
+ * @param[in] task
+ *   Task to start from the top of its thread
+ *
+ * @param[in] event_id
+ *   Scheduler event the thread runs from, below 32 so drivers can take it as a callback mask
+ *
+ ******************************************************************************/
+void task_open(TASK *task, uint32_t event_id){
+  EFM_ASSERT(event_id < 32);
+
+  task->lc = 0;
+  task->eventId = (uint8_t)event_id;
+  task->timer.index = RTCC_TIMER_IDLE;
+  scheduler_post(event_id);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Makes the thread of a task check its wait again
+ *
+ * @details
+ *  Safe from interrupts. Signals before the thread runs are merged into one dispatch.
+ *
+ ******************************************************************************/
+void task_signal(TASK *task){
+  scheduler_post(task->eventId);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Event mask to hand a driver as the callback that resumes the task
+ *
+ ******************************************************************************/
+uint32_t task_event(const TASK *task){
+  return SCHEDULER_EVENT_MASK(task->eventId);
+}
+
+/***************************************************************************/
+/**
+ * @brief
+ *   Arms the delay TASK_DELAY waits on
+ *
+ * @param[in] task
+ *   Task signalled once the delay expires
+ *
+ * @param[in] ms
+ *   Delay in ms
+ *
+ ******************************************************************************/
+void task_delay_start(TASK *task, uint32_t ms){
+  rtcc_timer_start(&task->timer, ms, 0, task_delay_done, task);
+}
@@ -52,48 +52,13 @@ int main(void)
 //    EMU_EnterEM2(true);
       CORE_DECLARE_IRQ_STATE;
       CORE_ENTER_CRITICAL();
-      if(!get_scheduled_events()){
+      if(!scheduler_pending()){
           enter_sleep();
       }
       CORE_EXIT_CRITICAL();
-//    uint32_t block;
-//    block = get_scheduled_event();
 
-    if(get_scheduled_events() & LETIMER0_UF_CB){
-      remove_scheduled_events(LETIMER0_UF_CB);
-      scheduled_letimer0_UF_cb();
-    }
-
-
-    if(get_scheduled_events() & LETIMER0_COMP1_CB){
-        remove_scheduled_events(LETIMER0_COMP1_CB);
-        scheduled_letimer0_COMP1_cb();
-    }
-    if(get_scheduled_events() & LETIMER0_COMP0_CB){
-        remove_scheduled_events(LETIMER0_COMP0_CB);
-        scheduled_letimer0_COMP0_cb();
-    }
-
-    if(get_scheduled_events() & GPIO_ODD_IRQ_CB){
-        remove_scheduled_events(GPIO_ODD_IRQ_CB);
-        scheduled_gpio_odd_irq_cb();
-    }
-    if(get_scheduled_events() & GPIO_EVEN_IRQ_CB){
-        remove_scheduled_events(GPIO_EVEN_IRQ_CB);
-        scheduled_gpio_even_irq_cb();
-    }
-    if (SI7021_READ_CB & get_scheduled_events()) {
-      remove_scheduled_events(SI7021_READ_CB);
-      scheduled_si7021_read_cb();
-    }
-    if (SI7021_READ_TEMP_CB & get_scheduled_events()){
-        remove_scheduled_events(SI7021_READ_TEMP_CB);
-        scheduled_si7021_read_temp_cb();
-    }
-    if(SH_CB & get_scheduled_events()){
-        remove_scheduled_events(SH_CB);
-        scheduled_SHTC3_read_cb();
-    }
+      // one handler per pass, the registered priorities decide which
+      scheduler_dispatch();
   }
 }
 
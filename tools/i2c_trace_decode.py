@@ -0,0 +1,93 @@
+#!/usr/bin/env python3
+"""Turns a binary dump of I2C_TRACE_ENTRY records into a timeline.
+
+The dump is the little endian I2C_TRACE_ENTRY array of src/Header_Files/i2c_trace.h,
+16 bytes per entry, either as filled by i2c_trace_copy() or the raw
+i2c_trace_buffer read with a debugger, for example
+
+    (gdb) dump binary memory trace.bin &i2c_trace_buffer &i2c_trace_buffer[64]
+
+A raw buffer is a ring, pass --head with i2c_trace_head so the oldest entry
+comes first. The event and state names are read from i2c_trace.h and I2C.h.
+
+    python3 tools/i2c_trace_decode.py trace.bin [--head N] [--hfperclk HZ]
+"""
+
+import argparse
+import os
+import re
+import struct
+import sys
+
+HEADERS = os.path.join(os.path.dirname(__file__), "..", "src", "Header_Files")
+
+# uint32_t time, uint16_t rtcc, uint8_t bus, type, state, spare[3], uint32_t arg
+ENTRY = struct.Struct("<IHBBB3xI")
+
+TRACE_PRESCALE = 16  # I2C_TRACE_PRESC, timerPrescale16
+
+
+def read_enum(path, typedef):
+    """Names of a typedef enum in declaration order."""
+    with open(path) as header:
+        text = header.read()
+    match = re.search(r"typedef\s+enum\s*\{([^}]*)\}\s*" + typedef + r"\s*;", text)
+    if not match:
+        raise SystemExit("%s not found in %s" % (typedef, path))
+    body = re.sub(r"//[^\n]*", "", match.group(1))
+    return [name.strip() for name in body.split(",") if name.strip()]
+
+
+def describe(type_name, arg, states):
+    if type_name == "I2C_TRACE_START":
+        return "device 0x%02X" % arg
+    if type_name == "I2C_TRACE_IRQ":
+        return "flags 0x%08X" % arg
+    if type_name == "I2C_TRACE_STATE":
+        return "from %s" % (states[arg] if arg < len(states) else arg)
+    if type_name == "I2C_TRACE_NACK":
+        return "retry %d" % arg
+    if type_name == "I2C_TRACE_COMPLETE":
+        return "%d interrupts" % arg
+    return ""
+
+
+def main(argv):
+    parser = argparse.ArgumentParser(description=__doc__.splitlines()[0])
+    parser.add_argument("dump", help="binary dump of I2C_TRACE_ENTRY records")
+    parser.add_argument("--head", type=int, default=0, help="i2c_trace_head of a raw ring buffer dump")
+    parser.add_argument("--hfperclk", type=float, default=32e6, help="HFPERCLK in Hz, 32 MHz by default")
+    args = parser.parse_args(argv[1:])
+
+    types = read_enum(os.path.join(HEADERS, "i2c_trace.h"), "I2C_TRACE_TYPE")
+    states = read_enum(os.path.join(HEADERS, "I2C.h"), "DEFINED_STATES")
+
+    with open(args.dump, "rb") as dump:
+        data = dump.read()
+    entries = [ENTRY.unpack_from(data, offset)
+               for offset in range(0, len(data) - ENTRY.size + 1, ENTRY.size)]
+    if args.head:
+        entries = entries[args.head:] + entries[:args.head]
+    # unwritten slots of a raw buffer are all zero
+    entries = [entry for entry in entries if any(entry)]
+
+    tick_us = TRACE_PRESCALE * 1e6 / args.hfperclk
+    print("%5s  %12s  %10s  %6s  %3s  %-20s  %-8s  %s" % (
+        "#", "time us", "delta us", "rtcc", "bus", "event", "state", "detail"))
+    first = previous = None
+    for index, (time, rtcc, bus, type_id, state, arg) in enumerate(entries):
+        if first is None:
+            first = previous = time
+        # the timer stops in EM2, so the times only order entries between RTCC steps
+        elapsed = ((time - first) & 0xFFFFFFFF) * tick_us
+        delta = ((time - previous) & 0xFFFFFFFF) * tick_us
+        previous = time
+        type_name = types[type_id] if type_id < len(types) else str(type_id)
+        state_name = states[state] if state < len(states) else str(state)
+        print("%5d  %12.1f  %10.1f  %6d  %3d  %-20s  %-8s  %s" % (
+            index, elapsed, delta, rtcc, bus, type_name, state_name, describe(type_name, arg, states)))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
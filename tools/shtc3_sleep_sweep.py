@@ -0,0 +1,68 @@
+#!/usr/bin/env python3
+"""Sweeps the SHTC3 sleep elision cost model over sample periods.
+
+Reads the cost model constants from src/Header_Files/SHTC3.h and applies the
+same charge comparison as shtc3_set_sample_period(), so the table follows the
+header. For each period it prints the mode picked, the I2C transactions per
+sample and the charge per sample of both modes. The measurement and its read
+cost the same in both modes and are left out.
+
+    python3 tools/shtc3_sleep_sweep.py [period_ms ...]
+"""
+
+import os
+import re
+import sys
+
+HEADER = os.path.join(os.path.dirname(__file__), "..", "src", "Header_Files", "SHTC3.h")
+
+# 100 ms to 60 s
+DEFAULT_PERIODS_MS = [100, 200, 500, 1000, 2000, 3000, 5000, 10000, 20000, 30000, 60000]
+
+SLEEP_TRANSACTIONS = 4  # wakeup, measure, read, sleep
+AWAKE_TRANSACTIONS = 2  # measure, read
+
+
+def read_defines(path):
+    defines = {}
+    with open(path) as header:
+        for line in header:
+            match = re.match(r"\s*#define\s+(SHTC3_\w+)\s+(\w+)", line)
+            if match:
+                defines[match.group(1)] = match.group(2)
+    return defines
+
+
+def model(defines, period_ms):
+    """Charges in fC, the integer arithmetic of shtc3_set_sample_period()."""
+    value = lambda name: int(defines[name])
+    sleep_cost = (value("SHTC3_MCU_ACTIVE_NA") * value("SHTC3_SLEEP_PAIR_US")
+                  + value("SHTC3_PULLUP_NA") * value("SHTC3_SLEEP_PAIR_BUS_US")
+                  + value("SHTC3_IDLE_NA") * value("SHTC3_WAKEUP_MS") * 1000)
+    awake_cost = (value("SHTC3_IDLE_NA") - value("SHTC3_SLEEP_NA")) * period_ms * 1000
+    keep_awake = defines["SHTC3_FORCE_KEEP_AWAKE"] == "true" or awake_cost < sleep_cost
+
+    # per sample totals, the sensor sits at sleep or idle current for the rest of the period
+    sleep_total = sleep_cost + value("SHTC3_SLEEP_NA") * period_ms * 1000
+    awake_total = value("SHTC3_IDLE_NA") * period_ms * 1000
+    return keep_awake, sleep_total, awake_total
+
+
+def main(argv):
+    defines = read_defines(HEADER)
+    periods = [int(arg) for arg in argv[1:]] or DEFAULT_PERIODS_MS
+
+    print("%10s  %-6s  %12s  %14s  %14s" % ("period ms", "mode", "xfers/sample", "sleep uC", "awake uC"))
+    for period_ms in periods:
+        keep_awake, sleep_total, awake_total = model(defines, period_ms)
+        print("%10d  %-6s  %12d  %14.3f  %14.3f" % (
+            period_ms,
+            "awake" if keep_awake else "sleep",
+            AWAKE_TRANSACTIONS if keep_awake else SLEEP_TRANSACTIONS,
+            sleep_total / 1e9,
+            awake_total / 1e9))
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))